@@ -0,0 +1,39 @@
+/* trace.h 
+ *     Definitions of the Nachos execution trace format, written by
+ *     "nachos -trace" (see machine/tracewriter.h) and read by tracestat.
+ *
+ *     A trace is a TraceHeader, followed by a stream of records, each a
+ *     tag byte and maybe a number.  Numbers are written 7 bits per byte,
+ *     low bits first, with the top bit set on all but the last byte;
+ *     signed numbers are first folded so that small negative numbers
+ *     are small too (0, -1, 1, -2, ... become 0, 1, 2, 3, ...).
+ *
+ *     Most instructions follow the one before in memory, so they are
+ *     counted in runs, and only the other ones record where they were,
+ *     as a distance from where the next instruction would have been.
+ *     Data addresses are recorded as a distance from the last one.
+ *     All addresses are virtual, in whatever address space was running.
+ */
+
+#define TRACEMAGIC	0xbadfade	/* first word of a trace file */
+
+typedef struct traceHeader {
+   int traceMagic;		/* should be TRACEMAGIC */
+   int pageSize;		/* PageSize of the machine traced */
+} TraceHeader;
+
+/* record tags */
+#define TraceRunMax	0x3f	/* 0x01..0x3f: that many instructions, each 
+				 * 4 bytes after the one before
+				 */
+#define TraceJump	0x40	/* one instruction, somewhere else: signed 
+				 * distance in words from where it would be
+				 */
+#define TraceAccess	0x80	/* | TraceWrite | log2(size): a load or 
+				 * store: signed distance from last address
+				 */
+#define TraceWrite	0x04
+#define TraceException	0xc0	/* | ExceptionType: a trap to the kernel: 
+				 * the bad virtual address, if any
+				 */
+#define TraceKindMask	0xc0	/* which of the above a tag is */
@@ -0,0 +1,280 @@
+/* tracestat.c
+ *
+ * This program reads an execution trace written by "nachos -trace", and
+ * reports what the user programs did: the instruction and memory access
+ * counts, the traps to the kernel, which pages were touched and how
+ * often, and the working set -- the number of distinct pages touched in
+ * each window of so many instructions.
+ *
+ * With -p, it also prints the trace, one line per instruction, access
+ * or trap, as "nachos -d m" would have shown them.
+ *
+ * Usage: tracestat [-p] [-w <instructions per window>] <trace file>
+ *
+ * See trace.h for the format of the trace.
+ *
+ * Copyright (c) 1992-1993 The Regents of the University of California.
+ * All rights reserved.  See copyright.h for copyright notice and limitation
+ * of liability and disclaimer of warranty provisions.
+ */
+
+#define MAIN
+#include "copyright.h"
+#undef MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define MaxPages	65536	/* distinct pages we can keep track of */
+#define NumExceptions	8	/* cf. ExceptionType in machine/machine.h */
+#define HotPages	10	/* # of most used pages to report */
+
+static char *exceptionNames[NumExceptions] = { "none", "syscall",
+	"page fault", "read-only", "bus error", "address error",
+	"overflow", "illegal instruction" };
+
+/* what we know about each page touched */
+typedef struct pageInfo {
+    unsigned int page;		/* virtual page number */
+    int inUse;			/* is this entry filled in? */
+    long fetches;		/* instructions executed from it */
+    long reads, writes;		/* loads and stores to it */
+    long window;		/* last window it was touched in */
+} PageInfo;
+
+static PageInfo pages[MaxPages];
+static int numPages = 0;
+
+static FILE *trace;
+static char *traceFileName;
+static int printing = 0;	/* -p: print each record */
+static long windowSize = 10000;	/* -w: instructions per window */
+static int pageSize;
+
+static long numInstrs = 0, numJumps = 0;
+static long numReads[3], numWrites[3];	/* by log2(size) */
+static long numTraps[NumExceptions];
+
+static long window = 0;		/* the current window, and the distinct */
+static long windowPages = 0;	/* pages touched in it so far */
+static long numWindows = 0, totalWindowPages = 0, maxWindowPages = 0;
+
+/* read a byte of the trace; -1 at the end */
+int
+GetByte()
+{
+    return getc(trace);
+}
+
+/* read a number, 7 bits per byte, low bits first */
+unsigned int
+GetNumber()
+{
+    unsigned int n = 0;
+    int shift = 0, byte;
+
+    do {
+	if ((byte = GetByte()) == EOF) {
+	    fprintf(stderr, "%s: trace ends in the middle of a record\n",
+		traceFileName);
+	    exit(1);
+	}
+	n |= (unsigned int)(byte & 0x7f) << shift;
+	shift += 7;
+    } while (byte & 0x80);
+    return n;
+}
+
+/* read a signed number: unfold 0, 1, 2, 3, ... into 0, -1, 1, -2, ... */
+int
+GetSigned()
+{
+    unsigned int n = GetNumber();
+
+    return (int)(n >> 1) ^ -(int)(n & 1);
+}
+
+/* find the entry for the page holding "addr", making one if need be */
+PageInfo *
+Lookup(unsigned int addr)
+{
+    unsigned int page = addr / pageSize;
+    unsigned int i = (page * 2654435761U) % MaxPages;
+
+    while (pages[i].inUse && pages[i].page != page)
+	i = (i + 1) % MaxPages;
+    if (!pages[i].inUse) {
+	if (numPages == MaxPages - 1) {
+	    fprintf(stderr, "%s: too many pages\n", traceFileName);
+	    exit(1);
+	}
+	pages[i].inUse = 1;
+	pages[i].page = page;
+	pages[i].window = -1;
+	numPages++;
+    }
+    if (pages[i].window != window) {	/* first touch in this window */
+	pages[i].window = window;
+	windowPages++;
+    }
+    return &pages[i];
+}
+
+/* start a new window, after every "windowSize" instructions */
+void
+EndWindow()
+{
+    numWindows++;
+    totalWindowPages += windowPages;
+    if (windowPages > maxWindowPages)
+	maxWindowPages = windowPages;
+    window++;
+    windowPages = 0;
+}
+
+/* count an instruction executed at "pc" */
+void
+Instruction(unsigned int pc)
+{
+    Lookup(pc)->fetches++;
+    if (printing)
+	printf("At PC = 0x%x\n", pc);
+    if (++numInstrs % windowSize == 0)
+	EndWindow();
+}
+
+/* compare two pages by how often they were used, most first */
+int
+MoreUsed(const void *a, const void *b)
+{
+    const PageInfo *p = (const PageInfo *)a, *q = (const PageInfo *)b;
+    long pUses = p->fetches + p->reads + p->writes;
+    long qUses = q->fetches + q->reads + q->writes;
+
+    return (pUses < qUses) - (pUses > qUses);
+}
+
+void
+Report()
+{
+    long codePages = 0, dataPages = 0;
+    int i, n;
+
+    if (windowPages > 0)		/* the last, partial, window */
+	EndWindow();
+    for (i = 0; i < MaxPages; i++) {
+	if (pages[i].fetches > 0)
+	    codePages++;
+	if (pages[i].reads + pages[i].writes > 0)
+	    dataPages++;
+    }
+
+    printf("Instructions: %ld (%ld not following the one before)\n",
+	numInstrs, numJumps);
+    printf("Loads: %ld/%ld/%ld, stores: %ld/%ld/%ld (bytes/halves/words)\n",
+	numReads[0], numReads[1], numReads[2],
+	numWrites[0], numWrites[1], numWrites[2]);
+    printf("Traps:");
+    for (i = 1; i < NumExceptions; i++)
+	printf(" %s %ld%s", exceptionNames[i], numTraps[i],
+	    (i < NumExceptions - 1) ? "," : "\n");
+    printf("Pages touched: %d (%ld with code, %ld with data), %d bytes each\n",
+	numPages, codePages, dataPages, pageSize);
+    if (numWindows > 0)
+	printf("Working set, per %ld instructions: average %.1f pages, "
+	    "max %ld\n", windowSize, (double)totalWindowPages / numWindows,
+	    maxWindowPages);
+
+    /* collect the pages at the front, and sort them */
+    for (i = 0, n = 0; i < MaxPages; i++)
+	if (pages[i].inUse)
+	    pages[n++] = pages[i];
+    qsort(pages, n, sizeof(PageInfo), MoreUsed);
+    printf("Most used pages:\n\tpage\tvaddr\tfetches\treads\twrites\n");
+    for (i = 0; i < n && i < HotPages; i++)
+	printf("\t%u\t0x%x\t%ld\t%ld\t%ld\n", pages[i].page,
+	    pages[i].page * pageSize, pages[i].fetches, pages[i].reads,
+	    pages[i].writes);
+}
+
+int
+main (int argc, char **argv)
+{
+    TraceHeader header;
+    unsigned int pc = 0, addr = 0, bad;
+    int tag, size, i;
+
+    for (argc--, argv++; argc > 1; argc--, argv++) {
+	if (!strcmp(*argv, "-p"))
+	    printing = 1;
+	else if (!strcmp(*argv, "-w") && argc > 2) {
+	    windowSize = atol(*(argv + 1));
+	    argc--, argv++;
+	} else
+	    break;
+    }
+    if (argc != 1 || windowSize <= 0) {
+	fprintf(stderr,
+	    "Usage: tracestat [-p] [-w <instructions per window>] <trace file>\n");
+	exit(1);
+    }
+    traceFileName = *argv;
+
+    if ((trace = fopen(traceFileName, "r")) == NULL) {
+	perror(traceFileName);
+	exit(1);
+    }
+    if (fread((char *)&header, sizeof(header), 1, trace) != 1 ||
+	    header.traceMagic != TRACEMAGIC) {
+	fprintf(stderr, "%s: not a Nachos trace\n", traceFileName);
+	exit(1);
+    }
+    pageSize = header.pageSize;
+
+    /* each instruction is recorded as where it was relative to the
+     * one before (pc), and each access relative to the last (addr)
+     */
+    while ((tag = GetByte()) != EOF) {
+	switch (tag & TraceKindMask) {
+	  case 0:			/* a run of instructions */
+	    for (i = 0; i < tag; i++) {
+		Instruction(pc);
+		pc += 4;
+	    }
+	    break;
+	  case TraceJump:
+	    pc += GetSigned() * 4;
+	    numJumps++;
+	    Instruction(pc);
+	    pc += 4;
+	    break;
+	  case TraceAccess:
+	    addr += GetSigned();
+	    size = tag & 3;
+	    if (tag & TraceWrite) {
+		Lookup(addr)->writes++;
+		numWrites[size]++;
+	    } else {
+		Lookup(addr)->reads++;
+		numReads[size]++;
+	    }
+	    if (printing)
+		printf("\t%s VA 0x%x, size %d\n",
+		    (tag & TraceWrite) ? "Writing" : "Reading", addr, 1 << size);
+	    break;
+	  case TraceException:
+	    bad = GetNumber();
+	    numTraps[tag & (NumExceptions - 1)]++;
+	    if (printing)
+		printf("Exception: %s, address 0x%x\n",
+		    exceptionNames[tag & (NumExceptions - 1)], bad);
+	    break;
+	}
+    }
+    fclose(trace);
+    Report();
+    exit(0);
+}
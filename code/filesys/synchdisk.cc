@@ -10,12 +10,16 @@
 //	handle one operation at a time, use a lock to enforce mutual
 //	exclusion.
 //
+//	While a thread waits for its request, it has at least IOPriority,
+//	so that (with -sched priority) it runs as soon as the disk is done.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // DiskRequestDone
@@ -71,10 +75,17 @@ SynchDisk::~SynchDisk()
 
 void SynchDisk::ReadSector(int sectorNumber, char *data)
 {
+    int start = stats->totalTicks;
+    int priority = currentThread->getPriority();
+
     lock->Acquire(); // only one disk I/O at a time
     disk->ReadRequest(sectorNumber, data);
+    if (priority < IOPriority) // run as soon as the disk is done
+        currentThread->setPriority(IOPriority);
     semaphore->P(); // wait for interrupt
+    currentThread->setPriority(priority);
     lock->Release();
+    stats->diskWait.EnterLog(stats->totalTicks - start);
 }
 
 //----------------------------------------------------------------------
@@ -88,10 +99,17 @@ void SynchDisk::ReadSector(int sectorNumber, char *data)
 
 void SynchDisk::WriteSector(int sectorNumber, char *data)
 {
+    int start = stats->totalTicks;
+    int priority = currentThread->getPriority();
+
     lock->Acquire(); // only one disk I/O at a time
     disk->WriteRequest(sectorNumber, data);
+    if (priority < IOPriority) // run as soon as the disk is done
+        currentThread->setPriority(IOPriority);
     semaphore->P(); // wait for interrupt
+    currentThread->setPriority(priority);
     lock->Release();
+    stats->diskWait.EnterLog(stats->totalTicks - start);
 }
 
 //----------------------------------------------------------------------
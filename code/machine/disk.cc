@@ -129,8 +129,11 @@ void Disk::ReadRequest(int sectorNumber, char *data)
         PrintSector(FALSE, sectorNumber, data);
 
     active = TRUE;
+    requestTime = stats->totalTicks;
     UpdateLast(sectorNumber);
     stats->numDiskReads++;
+    if (timeline != NULL)
+        timeline->DiskRequest(sectorNumber, FALSE, ticks);
     interrupt->Schedule(DiskDone, (_int)this, ticks, DiskInt);
 }
 
@@ -148,8 +151,11 @@ void Disk::WriteRequest(int sectorNumber, char *data)
         PrintSector(TRUE, sectorNumber, data);
 
     active = TRUE;
+    requestTime = stats->totalTicks;
     UpdateLast(sectorNumber);
     stats->numDiskWrites++;
+    if (timeline != NULL)
+        timeline->DiskRequest(sectorNumber, TRUE, ticks);
     interrupt->Schedule(DiskDone, (_int)this, ticks, DiskInt);
 }
 
@@ -162,6 +168,7 @@ void Disk::WriteRequest(int sectorNumber, char *data)
 void Disk::HandleInterrupt()
 {
     active = FALSE;
+    stats->diskLatency.EnterLog(stats->totalTicks - requestTime);
     (*handler)(handlerArg);
 }
 
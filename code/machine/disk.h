@@ -83,6 +83,7 @@ private:
                            // when any disk request finishes
   _int handlerArg;         // Argument to interrupt handler
   bool active;             // Is a disk operation in progress?
+  int requestTime;         // When it was asked for
   int lastSector;          // The previous disk request
   int bufferInit;          // When the track buffer started
                            // being loaded
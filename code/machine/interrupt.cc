@@ -26,9 +26,10 @@
 
 // String definitions for debugging messages
 
-static char *intLevelNames[] = {"off", "on"};
-static char *intTypeNames[] = {"timer", "disk", "console write",
-                               "console read", "network send", "network recv"};
+static const char *intLevelNames[] = {"off", "on"};
+static const char *intTypeNames[] = {"timer", "disk", "console write",
+                                     "console read", "network send",
+                                     "network recv", "scheduler"};
 
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -48,6 +49,9 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, _int param, int time,
     arg = param;
     when = time;
     type = kind;
+    order = 0;
+    index = -1;
+    nextFree = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -60,10 +64,17 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, _int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    maxPending = 16; // grows as needed
+    pending = new PendingInterrupt *[maxPending];
+    numPending = 0;
+    numScheduled = 0;
+    freePending = NULL;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
+    interrupted = SystemMode;
+    numHandled = 0;
+    nextDue = NeverDue;
 }
 
 //----------------------------------------------------------------------
@@ -73,9 +84,16 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-        delete pending->Remove();
-    delete pending;
+    PendingInterrupt *p;
+
+    for (int i = 0; i < numPending; i++)
+        delete pending[i];
+    delete[] pending;
+    while ((p = freePending) != NULL)
+    {
+        freePending = p->nextFree;
+        delete p;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -162,6 +180,11 @@ void Interrupt::OneTick()
     }
     DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
 
+    // nothing can be due before nextDue, so don't bother looking
+    // (unless we are tracing what the check does)
+    if (stats->totalTicks < nextDue && !DebugIsEnabled('i'))
+        return;
+
     // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff); // first, turn off interrupts
                                 // (interrupt handlers run with
@@ -241,6 +264,10 @@ void Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
     stats->Print();
+#ifdef USER_PROGRAM
+    if (profiler != NULL)
+        profiler->Report();
+#endif
     Cleanup(); // Never returns.
 }
 
@@ -249,7 +276,7 @@ void Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: just put it on a heap, sorted by when it is due.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -259,17 +286,211 @@ void Interrupt::Halt()
 //	"fromNow" is how far in the future (in simulated time) the
 //		 interrupt is to occur
 //	"type" is the hardware device that generated the interrupt
+//
+// Returns:
+//	A handle on the interrupt, which the device may pass to Cancel.
 //----------------------------------------------------------------------
-void Interrupt::Schedule(VoidFunctionPtr handler, _int arg, int fromNow, IntType type)
+IntHandle
+Interrupt::Schedule(VoidFunctionPtr handler, _int arg, int fromNow, IntType type)
 {
     int when = stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
+    PendingInterrupt *toOccur = NewPending(handler, arg, when, type);
 
     DEBUG('i', "Scheduling interrupt handler the %s at time = %d\n",
           intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    Insert(toOccur);
+    UpdateNextDue();
+    return IntHandle(toOccur);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Cancel
+// 	Take an interrupt that hasn't fired yet off the pending heap, so
+//	that it never happens (for instance, because the device has been
+//	turned off).  Returns FALSE, doing nothing, if it has fired (or
+//	been called off) already -- even if its PendingInterrupt has been
+//	re-used since, for an interrupt that is pending.
+//
+//	"h" is what Schedule returned for the interrupt
+//----------------------------------------------------------------------
+bool Interrupt::Cancel(IntHandle h)
+{
+    PendingInterrupt *p = h.pending;
+    int i;
+
+    ASSERT(h.IsSet());
+    i = p->index;
+    if (i < 0 || p->order != h.order)
+        return FALSE; // it is gone, and "p" isn't ours any more
+    ASSERT(i < numPending && pending[i] == p);
+    DEBUG('i', "Cancelling interrupt handler the %s at time = %d\n",
+          intTypeNames[p->type], p->when);
+    if (--numPending > i)
+    { // fill the hole with the last one, and move it into place
+        pending[i] = pending[numPending];
+        pending[i]->index = i;
+        if (i > 0 && pending[i]->Before(pending[(i - 1) / 2]))
+            SiftUp(i);
+        else
+            SiftDown(i);
+    }
+    FreePending(p);
+    UpdateNextDue();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::UpdateNextDue
+// 	Remember when the first pending interrupt is due, so that OneTick
+//	(and the CPU simulation, which runs user instructions in bursts
+//	up to that time) can tell cheaply that nothing is ready yet.
+//	Called whenever "pending" changes.
+//----------------------------------------------------------------------
+
+void Interrupt::UpdateNextDue()
+{
+    nextDue = (numPending == 0) ? NeverDue : pending[0]->when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::NewPending, Interrupt::FreePending
+// 	Allocate and free PendingInterrupts.  The ones that have fired
+//	are kept for re-use, since devices schedule an interrupt for
+//	nearly every one they handle.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::NewPending(VoidFunctionPtr handler, _int arg, int when,
+                      IntType type)
+{
+    PendingInterrupt *p = freePending;
+
+    if (p == NULL)
+        return new PendingInterrupt(handler, arg, when, type);
+    freePending = p->nextFree;
+    p->handler = handler;
+    p->arg = arg;
+    p->when = when;
+    p->type = type;
+    return p;
+}
+
+void Interrupt::FreePending(PendingInterrupt *p)
+{
+    p->index = -1;
+    p->nextFree = freePending;
+    freePending = p;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Insert
+// 	Add "p" to the pending heap.  It goes after any interrupts already
+//	due at the same time.
+//----------------------------------------------------------------------
+
+void Interrupt::Insert(PendingInterrupt *p)
+{
+    if (numPending == maxPending)
+    { // make room
+        PendingInterrupt **bigger = new PendingInterrupt *[2 * maxPending];
+
+        for (int i = 0; i < numPending; i++)
+            bigger[i] = pending[i];
+        delete[] pending;
+        pending = bigger;
+        maxPending *= 2;
+    }
+    p->order = numScheduled++;
+    p->index = numPending;
+    pending[numPending++] = p;
+    SiftUp(p->index);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::RemoveFirst
+// 	Take the interrupt that is due first off the pending heap, and
+//	return it; NULL if there is none.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::RemoveFirst()
+{
+    PendingInterrupt *first;
+
+    if (numPending == 0)
+        return NULL;
+    first = pending[0];
+    first->index = -1;
+    if (--numPending > 0)
+    {
+        pending[0] = pending[numPending];
+        pending[0]->index = 0;
+        SiftDown(0);
+    }
+    return first;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SiftUp, Interrupt::SiftDown
+// 	Move pending[i] towards the top (or bottom) of the heap until it
+//	is due no sooner than its parent, and no later than its children.
+//----------------------------------------------------------------------
+
+void Interrupt::SiftUp(int i)
+{
+    PendingInterrupt *p = pending[i];
+
+    while (i > 0 && p->Before(pending[(i - 1) / 2]))
+    {
+        pending[i] = pending[(i - 1) / 2];
+        pending[i]->index = i;
+        i = (i - 1) / 2;
+    }
+    pending[i] = p;
+    p->index = i;
+}
+
+void Interrupt::SiftDown(int i)
+{
+    PendingInterrupt *p = pending[i];
+    int child;
+
+    while ((child = 2 * i + 1) < numPending)
+    {
+        if (child + 1 < numPending && pending[child + 1]->Before(pending[child]))
+            child++; // the child due first
+        if (!pending[child]->Before(p))
+            break;
+        pending[i] = pending[child];
+        pending[i]->index = i;
+        i = child;
+    }
+    pending[i] = p;
+    p->index = i;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SortedPending
+// 	Return a new array of the pending interrupts, in the order they
+//	will fire, for printing and saving them.  The caller deletes it.
+//----------------------------------------------------------------------
+
+PendingInterrupt **
+Interrupt::SortedPending()
+{
+    PendingInterrupt **sorted = new PendingInterrupt *[numPending + 1];
+
+    for (int i = 0; i < numPending; i++)
+    { // insertion sort: there are only ever a few
+        int j = i;
+
+        for (; j > 0 && pending[i]->Before(sorted[j - 1]); j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = pending[i];
+    }
+    return sorted;
 }
 
 //----------------------------------------------------------------------
@@ -288,35 +509,34 @@ void Interrupt::Schedule(VoidFunctionPtr handler, _int arg, int fromNow, IntType
 bool Interrupt::CheckIfDue(bool advanceClock)
 {
     MachineStatus old = status;
+    PendingInterrupt *toOccur;
     int when;
+    double hostStart;
 
     ASSERT(level == IntOff); // interrupts need to be disabled,
                              // to invoke an interrupt handler
     if (DebugIsEnabled('i'))
         DumpState();
-    PendingInterrupt *toOccur =
-        (PendingInterrupt *)pending->SortedRemove(&when);
-
-    if (toOccur == NULL) // no pending interrupts
+    if (numPending == 0) // no pending interrupts
         return FALSE;
+    toOccur = pending[0];
+    when = toOccur->when;
 
     if (advanceClock && when > stats->totalTicks)
     { // advance the clock
+        if (timeline != NULL)
+            timeline->Idle(stats->totalTicks, when);
         stats->idleTicks += (when - stats->totalTicks);
         stats->totalTicks = when;
     }
     else if (when > stats->totalTicks)
-    { // not time yet, put it back
-        pending->SortedInsert(toOccur, when);
-        return FALSE;
-    }
+        return FALSE; // not time yet
 
     // Check if there is nothing more to do, and if so, quit
-    if ((status == IdleMode) && (toOccur->type == TimerInt) && pending->IsEmpty())
-    {
-        pending->SortedInsert(toOccur, when);
+    if ((status == IdleMode) && (toOccur->type == TimerInt) && numPending == 1)
         return FALSE;
-    }
+    RemoveFirst();
+    UpdateNextDue();
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n",
           intTypeNames[toOccur->type], toOccur->when);
@@ -325,13 +545,19 @@ bool Interrupt::CheckIfDue(bool advanceClock)
         machine->DelayedLoad(0, 0);
 #endif
     inHandler = TRUE;
+    interrupted = old;
+    numHandled++;
     status = SystemMode;                 // whatever we were doing,
                                          // we are now going to be
                                          // running in the kernel
+    hostStart = (timeline != NULL) ? HostSeconds() : 0;
     (*(toOccur->handler))(toOccur->arg); // call the interrupt handler
+    if (timeline != NULL)
+        timeline->InterruptHandled(intTypeNames[toOccur->type], when,
+                                   hostStart);
     status = old;                        // restore the machine status
     inHandler = FALSE;
-    delete toOccur;
+    FreePending(toOccur);
     return TRUE;
 }
 
@@ -342,10 +568,8 @@ bool Interrupt::CheckIfDue(bool advanceClock)
 //----------------------------------------------------------------------
 
 static void
-PrintPending(_int arg)
+PrintPending(PendingInterrupt *pend)
 {
-    PendingInterrupt *pend = (PendingInterrupt *)arg;
-
     printf("Interrupt handler %s, scheduled at %d\n",
            intTypeNames[pend->type], pend->when);
 }
@@ -360,9 +584,87 @@ void Interrupt::DumpState()
 {
     printf("Time: %d, interrupts %s\n", stats->totalTicks,
            intLevelNames[level]);
+    PendingInterrupt **sorted = SortedPending();
+
     printf("Pending interrupts:\n");
     fflush(stdout);
-    pending->Mapcar(PrintPending);
+    for (int i = 0; i < numPending; i++)
+        PrintPending(sorted[i]);
+    delete[] sorted;
     printf("End of pending interrupts\n");
     fflush(stdout);
 }
+
+//----------------------------------------------------------------------
+// Interrupt::Checkpoint
+// 	Write when each pending interrupt is due, and from which kind of
+//	device, to the open UNIX file "fd".  The handlers themselves are
+//	addresses in this Nachos binary, so we don't save them; see
+//	Restore.
+//----------------------------------------------------------------------
+
+void Interrupt::Checkpoint(int fd)
+{
+    PendingInterrupt **sorted = SortedPending();
+    int type;
+
+    WriteFile(fd, (char *)&numPending, sizeof(int));
+    for (int i = 0; i < numPending; i++)
+    {
+        type = sorted[i]->type;
+        WriteFile(fd, (char *)&sorted[i]->when, sizeof(int));
+        WriteFile(fd, (char *)&type, sizeof(int));
+    }
+    delete[] sorted;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Restore
+// 	Read back the interrupts written by Checkpoint.  The devices must
+//	have been set up as they were when the checkpoint was taken (for
+//	instance, the timer, with -rs), so for each saved interrupt there
+//	should be one of the same kind already pending; we move it to the
+//	saved time.  Interrupts this run has scheduled that weren't saved
+//	stay as they are.
+//
+//	A saved interrupt with no match is dropped: it was for something
+//	the checkpoint doesn't hold, such as a disk request of a kernel
+//	thread, or another -checkpoint.  So is every scheduler interrupt,
+//	since those are for real-time kernel threads, not devices.
+//
+//	Call after stats->Restore, so the times agree with totalTicks.
+//----------------------------------------------------------------------
+
+void Interrupt::Restore(int fd)
+{
+    PendingInterrupt **fresh = SortedPending(); // the ones of this run
+    int numFresh = numPending, count, when, type, j;
+
+    numPending = 0; // put them back as they are matched up
+    Read(fd, (char *)&count, sizeof(int));
+    for (int i = 0; i < count; i++)
+    {
+        Read(fd, (char *)&when, sizeof(int));
+        Read(fd, (char *)&type, sizeof(int));
+        for (j = 0; j < numFresh; j++)
+            if (fresh[j] != NULL && fresh[j]->type == type &&
+                type != SchedulerInt)
+                break;
+        if (j == numFresh)
+        {
+            DEBUG('i', "Dropping the %s interrupt at time %d: nothing "
+                       "to restore it to\n", intTypeNames[type], when);
+            continue;
+        }
+        DEBUG('i', "Restoring the %s interrupt at time %d\n",
+              intTypeNames[type], when);
+        fresh[j]->when = when;
+        Insert(fresh[j]);
+        fresh[j] = NULL;
+    }
+    for (j = 0; j < numFresh; j++)
+        if (fresh[j] != NULL)
+            Insert(fresh[j]);
+    delete[] fresh;
+    UpdateNextDue();
+}
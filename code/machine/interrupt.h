@@ -48,9 +48,10 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 
 // IntType records which hardware device generated an interrupt.
 // In Nachos, we support a hardware timer device, a disk, a console
-// display and keyboard, and a network.
+// display and keyboard, and a network.  The scheduler uses timer
+// interrupts of its own (SchedulerInt) for real-time threads.
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-				NetworkSendInt, NetworkRecvInt};
+				NetworkSendInt, NetworkRecvInt, SchedulerInt};
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
@@ -67,8 +68,37 @@ class PendingInterrupt {
     _int arg;           // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+
+    unsigned int order;		// when it was scheduled, relative to the
+				// others: interrupts due at the same time
+				// fire in the order they were scheduled
+    int index;			// where it is in the pending heap
+    PendingInterrupt *nextFree;	// next on the list of unused ones
+
+    bool Before(PendingInterrupt *other) // is this one due first?
+	{ return when < other->when ||
+		(when == other->when && order < other->order); }
 };
 
+// What Schedule returns, for calling the interrupt off: the
+// PendingInterrupt, and its "order".  PendingInterrupts are re-used
+// once they have fired, and the order tells the interrupt a handle was
+// made for from a later one in the same PendingInterrupt, so a handle
+// that is kept too long can't call that one off (see Cancel).
+
+class IntHandle {
+  public:
+    IntHandle() { pending = NULL; order = 0; }	// no interrupt
+    IntHandle(PendingInterrupt *p) { pending = p; order = p->order; }
+    bool IsSet() { return pending != NULL; }
+
+    PendingInterrupt *pending;
+    unsigned int order;
+};
+
+// Value of getNextDue() when no interrupt is pending.
+#define NeverDue 0x7fffffff
+
 // The following class defines the data structures for the simulation
 // of hardware interrupts.  We record whether interrupts are enabled
 // or disabled, and any hardware interrupts that are scheduled to occur
@@ -96,9 +126,25 @@ class Interrupt {
 					// from an interrupt handler
 
     MachineStatus getStatus() { return status; } // idle, kernel, user
+    int getNumHandled() { return numHandled; } // # of handlers invoked
+    int getNextDue() { return nextDue; } // when the next interrupt is
+    					// due, or NeverDue if none is pending
     void setStatus(MachineStatus st) { status = st; }
+    void SwitchCPU(IntStatus cpuLevel, MachineStatus cpuStatus)
+    	{ level = cpuLevel; status = cpuStatus; } // take up the level
+    					// and status of the CPU that is
+    					// entering the kernel, as it left
+    					// them (see userprog/smp.h)
+    MachineStatus getInterruptedStatus() { return interrupted; }
+    					// what the machine was doing when
+    					// the running handler was called
+    bool isInHandler() { return inHandler; } // is a handler running?
 
     void DumpState();			// Print interrupt state
+
+    void Checkpoint(int fd);		// Save when each pending interrupt
+    void Restore(int fd);		// is due, and re-time the devices'
+    					// interrupts to match
     
 
     // NOTE: the following are internal to the hardware simulation code.
@@ -106,20 +152,35 @@ class Interrupt {
     // but they need to be public since they are called by the
     // hardware device simulators.
 
-    void Schedule(VoidFunctionPtr handler,// Schedule an interrupt to occur
-	_int arg, int when, IntType type);// at time ``when''.  This is called
-    					// by the hardware device simulators.
+    IntHandle Schedule(VoidFunctionPtr handler, // Schedule an
+	_int arg, int when, IntType type);// interrupt to occur at time
+    					// ``when''.  This is called by the
+    					// hardware device simulators.
+    bool Cancel(IntHandle h);		// Call off an interrupt that
+    					// Schedule returned, unless it has
+    					// fired already
     
     void OneTick();       		// Advance simulated time
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    PendingInterrupt **pending;	// the interrupts scheduled to occur in
+				// the future: a binary heap, ordered by
+				// Before, so pending[0] is due first
+    int numPending;		// # of interrupts in the heap
+    int maxPending;		// size of the "pending" array
+    unsigned int numScheduled;	// for PendingInterrupt::order
+    PendingInterrupt *freePending; // PendingInterrupts to re-use
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
     MachineStatus status;	// idle, kernel mode, user mode
+    MachineStatus interrupted;	// status before the current handler
+    int numHandled;		// how many interrupt handlers have run;
+				// lets the CPU simulation notice that
+				// the kernel may have changed its state
+    int nextDue;		// "when" of the first pending interrupt;
+				// until then, OneTick need not look
 
     // these functions are internal to the interrupt simulation code
 
@@ -128,6 +189,17 @@ class Interrupt {
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
+
+    void UpdateNextDue();		// recompute nextDue from "pending"
+
+    PendingInterrupt *NewPending(VoidFunctionPtr handler, _int arg,
+	int when, IntType type);	// get a PendingInterrupt from the pool
+    void FreePending(PendingInterrupt *p); // and give it back
+    void Insert(PendingInterrupt *p);	// add "p" to the heap, in order
+    PendingInterrupt *RemoveFirst();	// take the first off the heap
+    void SiftUp(int i);			// restore the heap order around
+    void SiftDown(int i);		// pending[i]
+    PendingInterrupt **SortedPending(); // a copy of the heap, sorted
 };
 
 #endif // INTERRRUPT_H
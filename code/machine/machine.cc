@@ -10,6 +10,19 @@
 #include "copyright.h"
 #include "machine.h"
 #include "system.h"
+#include "tracewriter.h"
+
+// The geometry of user memory (see machine.h).  The kernel may change
+// these, from the command line, until the Machine is created.
+int pageSize = DefaultPageSize;
+int pageShift = 0;
+int numPhysPages = DefaultNumPhysPages;
+int tlbSize = DefaultTLBSize;
+int tlbWays = 0;
+TLBPolicy tlbPolicy = TLBRandom;
+bool tlbASIDs = FALSE;
+PageTableKind pageTableKind = LinearTable;
+char *memoryFile = NULL;
 
 // Textual names of the exceptions that can be generated by user program
 // execution, for debugging.
@@ -50,28 +63,116 @@ static void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"whichEngine" -- how user instructions are to be executed
+//	"memory" -- if not NULL, this is another CPU of the same machine,
+//		and that is the main memory they share
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, ExecEngine whichEngine, char *memory)
 {
     int i;
+    size_t slotSize, pageDecodeSize;
+
+    ASSERT(pageSize >= 4 && (pageSize & (pageSize - 1)) == 0);
+    for (pageShift = 0; (1 << pageShift) < pageSize; pageShift++)
+        ;
+    ASSERT(numPhysPages > 0 && tlbSize > 0);
+    ASSERT(numPhysPages <= 0x7fffffff / pageSize); // physical addresses are ints
+
+    // The decode slots of a page are only made when it is first fetched
+    // from, but every page might hold code: make sure the host could
+    // address all of them, even if it is a 32-bit one.
+    slotSize = sizeof(Instruction) + sizeof(bool) + sizeof(TranslatedBlock *) +
+               sizeof(unsigned char);
+    pageDecodeSize = 0;
+    if ((size_t)DecodeSlotsPerPage <= ((size_t)-1) / slotSize)
+        pageDecodeSize = (size_t)DecodeSlotsPerPage * slotSize;
+    if (pageDecodeSize == 0 ||
+        (size_t)numPhysPages > ((size_t)-1) / pageDecodeSize)
+    {
+        fprintf(stderr, "Machine too big: %d pages of %d bytes need more "
+                        "decoded instruction space than this host can address\n",
+                numPhysPages, pageSize);
+        Exit(1);
+    }
+    DEBUG('a', "Machine has %d pages of %d bytes, %d TLB entries\n",
+          numPhysPages, pageSize, tlbSize);
 
     for (i = 0; i < NumTotalRegs; i++)
         registers[i] = 0;
-    mainMemory = new char[MemorySize];
-    for (i = 0; i < MemorySize; i++)
-        mainMemory[i] = 0;
+    // Memory comes zero-filled from the host, which only allocates the
+    // pages that get used -- so even a very large memory costs nothing
+    // until then.
+    ownMemory = (memory == NULL);
+    mainMemory = ownMemory ? MapMemory(memoryFile, MemorySize) : memory;
+    codeEpoch = 0;
+    decodedPages = new DecodedPage *[numPhysPages];
+    decodePageValid = new bool[numPhysPages];
+    for (i = 0; i < numPhysPages; i++)
+    {
+        decodedPages[i] = NULL; // until NewDecodedPage
+        decodePageValid[i] = FALSE;
+    }
+    fetchedPage = 0;
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
+    tlb = new TranslationEntry[tlbSize];
+    for (i = 0; i < tlbSize; i++)
         tlb[i].valid = FALSE;
     pageTable = NULL;
 #else // use linear page table
     tlb = NULL;
     pageTable = NULL;
 #endif
+    tableKind = LinearTable;
+    pageDirectory = NULL;
+    invertedTable = NULL; // until an address space uses it
+
+    tlbSetWays = (tlbWays == 0) ? tlbSize : tlbWays;
+    tlbSets = tlbSize / tlbSetWays;
+    ASSERT(tlbSets * tlbSetWays == tlbSize && (tlbSets & (tlbSets - 1)) == 0);
+    // a load or store needs the translations of both its code and its
+    // data page at once, and they may fall in the same set
+    ASSERT(tlb == NULL || tlbSetWays >= 2);
+    ASSERT(tlbPolicy != TLBPseudoLRU ||
+           (tlbSetWays <= 32 && (tlbSetWays & (tlbSetWays - 1)) == 0));
+    tlbASID = new int[tlbSize];
+    tlbStamp = new unsigned int[tlbSize];
+    for (i = 0; i < tlbSize; i++)
+        tlbASID[i] = tlbStamp[i] = 0;
+    tlbTree = new unsigned int[tlbSets];
+    for (i = 0; i < tlbSets; i++)
+        tlbTree[i] = 0;
+    currentASID = 0;
+    tlbClock = 0;
+
+    // Trace every access; and the TLB must see every use, to know
+    // which entry was least recently used
+    hostTLBEnabled = !DebugIsEnabled('a') &&
+                     (tlb == NULL || tlbPolicy == TLBRandom);
+    FlushHostTLB();
 
     singleStep = debug;
+    engine = whichEngine;
+    burstTicks = !debug && !DebugIsEnabled('i'); // see every tick if tracing
+    burstLeft = burstRun = 0;
+
+    config = 0; // compile out whatever we won't need
+    if (DebugIsEnabled('m') || DebugIsEnabled('a'))
+        config |= TraceConfig;
+    if (tlb != NULL)
+        config |= TLBConfig;
+    if (debug)
+        config |= StepConfig;
+
+    ASSERT(NumExceptionTypes <= MaxExceptionTypes); // see stats.h
+    userTicksAtTrap = 0;
+
+    profileCounts = NULL; // until the kernel says what to count
+    profileWords = 0;
+    profileOps = NULL;
+    trace = NULL; // unless EnableTrace
+    cpuNum = -1;  // the only CPU, unless the kernel says otherwise
+    counts = stats;
     CheckEndian();
 }
 
@@ -82,9 +183,27 @@ Machine::Machine(bool debug)
 
 Machine::~Machine()
 {
-    delete[] mainMemory;
+    for (int i = 0; i < numPhysPages; i++)
+        if (decodedPages[i] != NULL)
+        {
+            InvalidateDecodedPage(i); // frees the translated blocks
+            delete[] decodedPages[i]->instr;
+            delete[] decodedPages[i]->valid;
+            delete[] decodedPages[i]->blockAt;
+            delete[] decodedPages[i]->heat;
+            delete decodedPages[i];
+        }
+    if (ownMemory)
+        UnmapMemory(mainMemory, MemorySize);
+    delete[] decodedPages;
+    delete[] decodePageValid;
     if (tlb != NULL)
         delete[] tlb;
+    delete[] tlbASID;
+    delete[] tlbStamp;
+    delete[] tlbTree;
+    delete invertedTable;
+    delete trace; // write out the rest of the trace
 }
 
 //----------------------------------------------------------------------
@@ -99,8 +218,18 @@ Machine::~Machine()
 
 void Machine::RaiseException(ExceptionType which, int badVAddr)
 {
+    bool entered;
+
     DEBUG('m', "Exception: %s\n", exceptionNames[which]);
 
+    entered = (cpuNum >= 0) && EnterKernel(cpuNum);
+    EndBurst(); // the kernel must see the right time
+    if (trace != NULL)
+        trace->Exception(which, badVAddr);
+    stats->numExceptions[which]++;
+    if (which == SyscallException)
+        stats->syscallCodes.Enter(registers[2]);
+    stats->userRuns.EnterLog(stats->userTicks - userTicksAtTrap);
     //  ASSERT(interrupt->getStatus() == UserMode);
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0); // finish anything in progress
@@ -108,6 +237,9 @@ void Machine::RaiseException(ExceptionType which, int badVAddr)
     ExceptionHandler(which); // interrupts are enabled at this point
                              // see userprog/exception.cc
     interrupt->setStatus(UserMode);
+    userTicksAtTrap = stats->userTicks;
+    if (entered)
+        LeaveKernel(cpuNum);
 }
 
 //----------------------------------------------------------------------
@@ -196,6 +328,56 @@ void Machine::DumpState()
     printf("\n");
 }
 
+//----------------------------------------------------------------------
+// Machine::Checkpoint
+// 	Write the user program's view of the machine -- the registers,
+//	all of main memory and the TLB, if any (with its ASID tags and
+//	replacement state) -- to the open UNIX file
+//	"fd".  The page table belongs to the address space, which saves
+//	it itself.
+//----------------------------------------------------------------------
+
+void Machine::Checkpoint(int fd)
+{
+    WriteFile(fd, (char *)registers, sizeof(registers));
+    WriteFile(fd, mainMemory, MemorySize);
+    if (tlb != NULL)
+    {
+        WriteFile(fd, (char *)tlb, tlbSize * sizeof(TranslationEntry));
+        WriteFile(fd, (char *)tlbASID, tlbSize * sizeof(int));
+        WriteFile(fd, (char *)tlbStamp, tlbSize * sizeof(unsigned int));
+        WriteFile(fd, (char *)tlbTree, tlbSets * sizeof(unsigned int));
+        WriteFile(fd, (char *)&tlbClock, sizeof(unsigned int));
+        WriteFile(fd, (char *)&currentASID, sizeof(int));
+    }
+    WriteFile(fd, (char *)&userTicksAtTrap, sizeof(int));
+}
+
+//----------------------------------------------------------------------
+// Machine::Restore
+// 	Read back the state written by Checkpoint.  Everything we had
+//	decoded or cached about the old contents of memory is thrown away.
+//----------------------------------------------------------------------
+
+void Machine::Restore(int fd)
+{
+    Read(fd, (char *)registers, sizeof(registers));
+    Read(fd, mainMemory, MemorySize);
+    if (tlb != NULL)
+    {
+        Read(fd, (char *)tlb, tlbSize * sizeof(TranslationEntry));
+        Read(fd, (char *)tlbASID, tlbSize * sizeof(int));
+        Read(fd, (char *)tlbStamp, tlbSize * sizeof(unsigned int));
+        Read(fd, (char *)tlbTree, tlbSets * sizeof(unsigned int));
+        Read(fd, (char *)&tlbClock, sizeof(unsigned int));
+        Read(fd, (char *)&currentASID, sizeof(int));
+    }
+    Read(fd, (char *)&userTicksAtTrap, sizeof(int));
+    for (int i = 0; i < numPhysPages; i++)
+        InvalidateDecodedPage(i);
+    FlushHostTLB();
+}
+
 //----------------------------------------------------------------------
 // Machine::ReadRegister/WriteRegister
 //   	Fetch or write the contents of a user program register.
@@ -24,17 +24,73 @@
 #include "copyright.h"
 #include "utility.h"
 #include "translate.h"
+#include "pagetable.h"
 #include "disk.h"
 
-// Definitions related to the size, and format of user memory
+// Definitions related to the size, and format of user memory.
+//
+// The geometry of user memory can be chosen when Nachos starts (-mem,
+// -pagesize and -tlbsize, see threads/main.cc), so it is kept in
+// variables rather than constants.  It must be set before the Machine
+// is created, and not changed afterwards; the page size must be a
+// power of two.
+
+// 为了简单起见，页大小默认和扇区大小相同，都是 128 Byte
+#define DefaultPageSize SectorSize
+#define DefaultNumPhysPages 64 // 物理页有多少
+#define DefaultTLBSize 4	   // if there is a TLB, make it small
+
+extern int pageSize;	 // bytes per page
+extern int pageShift;	 // log2(pageSize), set by the Machine
+extern int numPhysPages; // # of pages of physical memory
+extern int tlbSize;		 // # of TLB entries, if there is a TLB
+
+// The organization of the TLB, if there is one (-tlbways, -tlbpolicy and
+// -tlbasid).  The TLB is divided into sets of tlbWays entries (at least
+// two; the number of sets must be a power of two), and a virtual page
+// can only be held in set (page # mod # of sets).  When the kernel
+// refills the TLB with LoadTLB, the hardware picks the entry to replace,
+// by tlbPolicy.
+//
+// With tlbASIDs, each entry is tagged with the address space it belongs
+// to (see SetASID), so the TLB needn't be emptied on a context switch.
+
+enum TLBPolicy
+{
+	TLBRandom,	 // any entry of the set (as on the MIPS R2000)
+	TLBLRU,		 // the least recently used entry of the set
+	TLBPseudoLRU // close to that, by a tree of bits per set
+};
+
+extern int tlbWays;			// entries per set; 0 for fully associative
+extern TLBPolicy tlbPolicy; // which entry LoadTLB replaces
+extern bool tlbASIDs;		// tag entries with address space ids
+
+// How Machine::Translate finds a translation, when there is no TLB.
+// Each address space picks one when it is created (by default, the one
+// set with -pagetable); see pagetable.h.
+
+enum PageTableKind
+{
+	LinearTable,   // pageTable, indexed by virtual page #
+	TwoLevelTable, // pageDirectory
+	InvertedTable  // invertedTable, looked up by the current ASID
+};
+
+extern PageTableKind pageTableKind; // for new address spaces
+
+extern char *memoryFile; // UNIX file holding physical memory (-memfile),
+						 // or NULL to forget it when Nachos exits
 
-// 为了简单起见，页大小和扇区大小相同，都是 128 Byte
-#define PageSize SectorSize
+#define MemorySize (numPhysPages * pageSize) // 内存总大小
 
-// 物理页有多少
-#define NumPhysPages 64						 // 32
-#define MemorySize (NumPhysPages * PageSize) // 内存总大小
-#define TLBSize 4							 // if there is a TLB, make it small
+// 每个物理页的预解码指令槽数（每字一个）
+#define DecodeSlotsPerPage (pageSize / 4)
+
+// Number of entries in the host-side translation cache (see HostTLBEntry);
+// must be a power of two.
+#define HostTLBSize 64
+#define HostTLBNone 0xffffffffU
 
 enum ExceptionType
 {
@@ -54,6 +110,38 @@ enum ExceptionType
 	NumExceptionTypes
 };
 
+// The engines that can execute user programs.  The interpreter
+// (OneInstruction) is always available, and is what is used when
+// single stepping or tracing instructions; the others are faster.
+enum ExecEngine
+{
+	InterpretEngine, // fetch, decode and switch on each instruction
+	ThreadedEngine,	 // direct-threaded dispatch, see RunThreaded
+	BlockEngine		 // threaded, plus translated basic blocks
+};
+
+// The simulation routines are templates, compiled once for each
+// combination of the features below that a run might need; Machine
+// picks the right one ("config") when it is created, so that a run
+// without, say, debugging doesn't pay for checking whether it is on.
+#define TraceConfig 1 // DEBUG tracing of instructions ('m') or
+					  // memory accesses ('a'), or recording
+					  // of a trace (EnableTrace), may be on
+#define TLBConfig 2	  // translate with the TLB, not a page table
+#define StepConfig 4  // the user program debugger may stop us
+#define ProfileConfig 8 // count executions of each instruction
+#define NumConfigs 16
+
+// Limits for the block engine: how often an instruction must be
+// reached before a block is translated starting there, and how long
+// a translated block may be.
+#define HotBlockThreshold 16
+#define MaxBlockLength 64
+
+// Decoded opcodes (the OP_ values of mipssim.h) are all less than this,
+// so that a profile can keep a count for each.
+#define NumOpcodes 64
+
 // User program CPU state.  The full set of MIPS registers, plus a few
 // more because we need to be able to start/stop a user program between
 // any two instructions (thus we need to keep track of things like load
@@ -73,6 +161,9 @@ enum ExceptionType
 
 #define NumTotalRegs 40
 
+class TraceWriter;
+class Statistics;
+
 // The following class defines an instruction, represented in both
 // 	undecoded binary form
 //      decoded to identify
@@ -92,6 +183,64 @@ public:
 	char rs, rt, rd; // Three registers from instruction.
 	int extra;		 // Immediate or target or shamt field or offset.
 					 // Immediates are sign-extended.
+	void *handler;	 // Code that executes this instruction in the
+					 // threaded engine, NULL until first needed
+	char mix;		 // What kind of instruction it is (InstrClass),
+					 // for stats
+};
+
+// The following class defines a translated basic block: a run of
+// consecutive instructions in one physical page, normally ending with
+// a branch or jump and its delay slot.  The block engine executes the
+// run without translating the PC for each instruction, and remembers
+// which blocks (on the same page) followed this one, so it can go
+// straight on to them.
+
+class TranslatedBlock
+{
+public:
+	Instruction *start;		  // its first instruction, in a DecodedPage
+	int length;				  // # of instructions, including delay slot
+	int nextPC[2];			  // where execution went after this block,
+	TranslatedBlock *next[2]; // and the block found there (NULL if none)
+};
+
+// The following class holds what has been decoded from one physical
+// page: a slot per word, with the pre-decoded instruction and any
+// translated block starting there.  It is only made the first time an
+// instruction is fetched from the page, so memory that never holds
+// code costs nothing more than a pointer.
+
+class DecodedPage
+{
+public:
+	Instruction *instr;		   // one pre-decoded instruction per word,
+							   // filled in on first fetch
+	bool *valid;			   // is the slot up to date?
+	TranslatedBlock **blockAt; // the translated block starting at each
+							   // slot, if any
+	unsigned char *heat;	   // # of times each slot was reached
+							   // without a block
+};
+
+// The following class defines an entry in the host-side translation
+// cache.  This is not part of the simulated hardware; it is a direct-mapped
+// cache, indexed by virtual page #, of the results of Translate(), so
+// that most loads, stores and instruction fetches take one compare and
+// one access to mainMemory.
+//
+// The tags are the virtual address of the start of the page, so an
+// aligned access hits iff (addr & (~(pageSize - 1) | (size - 1))) == tag;
+// misaligned accesses always miss, and take the slow path to get their
+// exception.  An unused tag is HostTLBNone, which nothing matches.
+
+class HostTLBEntry
+{
+public:
+	unsigned int readTag;  // page address, if reads may use this entry
+	unsigned int writeTag; // page address, if writes may use it too
+	char *hostPage;		   // where the page is, in mainMemory
+	int physPage;		   // the physical page #
 };
 
 // The following class defines the simulated host workstation hardware, as
@@ -110,8 +259,11 @@ public:
 class Machine
 {
 public:
-	Machine(bool debug); // Initialize the simulation of the hardware
-						 // for running user programs
+	Machine(bool debug, ExecEngine whichEngine, char *memory = NULL);
+	// Initialize the simulation of the hardware
+	// for running user programs; "memory", if
+	// not NULL, is the main memory of another
+	// CPU, to share
 	~Machine();			 // De-allocate the data structures
 
 	// Routines callable by the Nachos kernel
@@ -124,17 +276,43 @@ public:
 
 	// Routines internal to the machine simulation -- DO NOT call these
 
-	void OneInstruction(Instruction *instr);
+	template <int Config>
+	void RunInterpreter();
+	// Run a user program with OneInstruction.
+	// Never returns.
+	template <int Config>
+	void OneInstruction();
 	// Run one instruction of a user program.
+	template <int Config>
+	void RunThreaded();
+	// Run a user program with the threaded
+	// or block engine.  Never returns.
+	TranslatedBlock *TranslateBlock(int physPage, int startSlot,
+									void **handlers);
+	// Build the block starting at a slot of
+	// a DecodedPage, for the block engine.
+	template <int Config>
+	Instruction *FetchInstruction();
+	// Translate the PC and return its decoded
+	// instruction, from the decode cache if
+	// possible.  NULL if an exception occurred.
 	void DelayedLoad(int nextReg, int nextVal);
 	// Do a pending delayed load (modifying a reg)
 
 	bool ReadMem(int addr, int size, int *value);
 	bool WriteMem(int addr, int size, int value);
+	template <int Config>
+	bool ReadMem(int addr, int size, int *value);
+	template <int Config>
+	bool WriteMem(int addr, int size, int value);
 	// Read or write 1, 2, or 4 bytes of virtual
 	// memory (at addr).  Return FALSE if a
 	// correct translation couldn't be found.
+	// (The kernel should use the plain versions,
+	// which call the right template.)
 
+	ExceptionType Translate(int virtAddr, int *physAddr, int size, bool writing);
+	template <int Config>
 	ExceptionType Translate(int virtAddr, int *physAddr, int size, bool writing);
 	// Translate an address, and check for
 	// alignment.  Set the use and dirty bits in
@@ -146,9 +324,45 @@ public:
 	// Trap to the Nachos kernel, because of a
 	// system call or other exception.
 
+	void InvalidateDecodedPage(int physPage);
+	// Throw away any pre-decoded instructions
+	// for a physical page whose contents
+	// have been modified.
+
+	void FlushHostTLB();
+	// Forget all cached translations; the kernel
+	// must call this whenever it changes pageTable
+	// or the tlb, or the entries in them.
+
+	void LoadTLB(TranslationEntry *entry);
+	// Copy "entry" into the TLB, in place of an
+	// entry of its set chosen by tlbPolicy (or
+	// of one for the same page), tagged with the
+	// current ASID.
+	void SetASID(int asid);
+	// Look up and load TLB (or inverted page
+	// table) entries for address space "asid"
+	// from now on.  Without tlbASIDs,
+	// this empties the TLB, if "asid" changes.
+	void FlushTLB(int asid);
+	// Invalidate the TLB entries of "asid".
+
+	void EnableProfile();
+	// Count how often each instruction is
+	// executed, in profileCounts and profileOps.
+	// Call before Run().
+
+	void EnableTrace(char *fileName);
+	// Record every instruction, load, store and
+	// trap in the trace file "fileName" (see
+	// tracewriter.h).  Call before Run().
+
 	void Debugger();  // invoke the user program debugger
 	void DumpState(); // print the user CPU and memory state
 
+	void Checkpoint(int fd); // save the registers, memory and TLB
+	void Restore(int fd);	 // to a UNIX file, and read them back
+
 	// Data structures -- all of these are accessible to Nachos kernel code.
 	// "public" for convenience.
 	//
@@ -163,10 +377,12 @@ public:
 	// to physical addresses (relative to the beginning of "mainMemory")
 	// can be controlled by one of:
 	//	a traditional linear page table
+	//	a two-level page table, or the machine's inverted page table
+	//	  (see pagetable.h), chosen by "tableKind"
 	//  	a software-loaded translation lookaside buffer (tlb) -- a cache of
 	//	  mappings of virtual page #'s to physical page #'s
 	//
-	// If "tlb" is NULL, the linear page table is used
+	// If "tlb" is NULL, the page table of kind "tableKind" is used
 	// If "tlb" is non-NULL, the Nachos kernel is responsible for managing
 	//	the contents of the TLB.  But the kernel can use any data structure
 	//	it wants (eg, segmented paging) for handling TLB cache misses.
@@ -176,14 +392,88 @@ public:
 	// space, stored in memory), there is only one TLB (implemented in hardware).
 	// Thus the TLB pointer should be considered as *read-only*, although
 	// the contents of the TLB are free to be modified by the kernel software.
+	//
+	// Translations are cached (see HostTLBEntry), so after switching page
+	// tables, or changing any entry of the page table or TLB (including
+	// clearing use or dirty bits), the kernel must call FlushHostTLB().
+
+	// If profiling is enabled, every instruction executed is counted in
+	// profileCounts (indexed by PC / 4, if less than profileWords) and
+	// in profileOps (indexed by opcode).  The kernel points these at
+	// the counts for the running address space, or sets profileOps
+	// to NULL if it isn't being profiled; see userprog/profile.h.
+
+	unsigned int *profileCounts;
+	unsigned int profileWords;
+	unsigned int *profileOps;
 
 	TranslationEntry *tlb; // this pointer should be considered
 						   // "read-only" to Nachos kernel code
 
+	PageTableKind tableKind; // which of these Translate walks
 	TranslationEntry *pageTable;
 	unsigned int pageTableSize;
+	PageDirectory *pageDirectory;
+	InvertedPageTable *invertedTable; // one for the whole machine,
+									  // shared by all address spaces
+									  // (made by the first of them)
+
+	// With more than one CPU (see userprog/smp.h), each is a Machine,
+	// and they share mainMemory.  "cpuNum" says which this is, so it
+	// can take and give up the kernel around each trap; it is -1 if
+	// there is only the one.  User instructions, taken branches and
+	// TLB lookups are counted in "counts": stats, or with more than
+	// one CPU, counts of the CPU's own.
+
+	int cpuNum;
+	Statistics *counts;
 
 private:
+	DecodedPage **decodedPages; // per physical page, NULL until an
+								// instruction is first fetched from it
+	bool *decodePageValid;	  // does the page have any valid slots?
+	int fetchedPage;		  // physical page of the last instruction
+							  // returned by FetchInstruction
+	int codeEpoch;			  // bumped whenever decoded code is discarded
+	DecodedPage *NewDecodedPage(int physPage);
+	// Make the (empty) decode slots for a
+	// page, when it is first fetched from.
+
+	HostTLBEntry hostTLB[HostTLBSize]; // cached results of Translate
+	bool hostTLBEnabled;			   // off when tracing translations, or
+									   // when the TLB must see every use
+	void RevokeHostTLBWrite(int physPage);
+	// Stop writes hitting in the hostTLB for a page,
+	// because it now holds decoded instructions.
+
+	int tlbSets;			// # of sets in the TLB, a power of two
+	int tlbSetWays;			// # of entries per set
+	int *tlbASID;			// the ASID each TLB entry belongs to
+	int currentASID;		// the ASID of the running address space
+	unsigned int *tlbStamp; // when each entry was last used (TLBLRU)
+	unsigned int tlbClock;	// counts uses, for tlbStamp
+	unsigned int *tlbTree;	// pseudo-LRU bits of each set
+	void TouchTLB(int index); // note a use of TLB entry "index"
+	int TLBVictim(int set);	  // the entry of "set" to replace
+
+	ExecEngine engine; // which engine Run() should use
+	int config;		   // which TraceConfig, TLBConfig and StepConfig
+					   // features this run needs
+
+	bool burstTicks; // run instructions in bursts, up to the next
+					 // interrupt, instead of checking after each
+	int burstLeft;	 // # of instructions the burst may still run
+	int burstRun;	 // # run so far, not yet charged to stats
+	void Tick();	 // advance time by one user instruction
+	void Profile(Instruction *instr); // count instr, at the PC
+	TraceWriter *trace; // where to record the execution, if anywhere
+
+	int userTicksAtTrap; // stats->userTicks when we last left the
+						 // kernel, for stats->userRuns
+	void EndBurst(); // charge the burst's ticks to stats
+
+	bool ownMemory;	  // mainMemory isn't another CPU's
+
 	bool singleStep;  // drop back into the debugger after each
 					  // simulated instruction
 	int runUntilTime; // drop back into the debugger when simulated
@@ -195,6 +485,18 @@ extern void ExceptionHandler(ExceptionType which);
 // user system calls and exceptions
 // Defined in exception.cc
 
+extern bool EnterKernel(int cpu);
+extern void LeaveKernel(int cpu);
+// With more than one CPU, wait for the
+// kernel, and give it up to go back to user
+// code.  EnterKernel returns FALSE if the
+// CPU is in the kernel already (a trap by the
+// kernel itself).  Defined in smp.cc
+
+extern void OpcodeName(int opCode, char *name, int maxLength);
+// The mnemonic of a decoded opcode, as in
+// the "m" debugging output (mipssim.cc)
+
 // Routines for converting Words and Short Words to and from the
 // simulated machine's format of little endian.  If the host machine
 // is little endian (DEC and Intel), these end up being NOPs.
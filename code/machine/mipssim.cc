@@ -15,11 +15,117 @@
 #include "machine.h"
 #include "mipssim.h"
 #include "system.h"
+#include "tracewriter.h"
 
 extern Machine *machine;
 
 static void Mult(int a, int b, bool signedArith, int *hiPtr, int *loPtr);
 
+//----------------------------------------------------------------------
+// Machine::Tick
+// 	Advance simulated time by one user instruction, as
+//	interrupt->OneTick() would.
+//
+//	Nothing can happen until the first pending interrupt is due, so
+//	rather than going through OneTick after every instruction, we run
+//	user instructions in bursts that end just before that time, and
+//	only count how many ran.  The ticks are charged to stats all at
+//	once, either when the burst runs out (and we call OneTick for the
+//	instruction that reaches the deadline, so interrupts are delivered
+//	exactly when they would have been), or by RaiseException, before
+//	the kernel can look at the clock.  So simulated time is exactly
+//	what it was; only the host work per instruction goes away.
+//
+//	With more than one CPU, this is where each takes its turn in the
+//	kernel, and the time to the next interrupt is shared out among
+//	them, since all their instructions advance the one clock.
+//----------------------------------------------------------------------
+
+inline void
+Machine::Tick()
+{
+	int fromNow;
+
+	if (burstRun < burstLeft)
+	{
+		burstRun++; // not due yet
+		return;
+	}
+	if (cpuNum >= 0)
+		(void)EnterKernel(cpuNum); // (from user code, so never nested)
+	EndBurst();
+	interrupt->OneTick();
+	if (burstTicks)
+	{ // start another burst; every CPU's instructions count
+		fromNow = interrupt->getNextDue() - stats->totalTicks;
+		burstLeft = (fromNow > 0) ? (fromNow - 1) / UserTick / numCPUs : 0;
+	}
+	if (cpuNum >= 0)
+		LeaveKernel(cpuNum);
+}
+
+//----------------------------------------------------------------------
+// Machine::EndBurst
+// 	Charge the ticks of the instructions run in the current burst
+//	to stats, and end the burst, so the next instruction goes
+//	through OneTick.  Called whenever anything else might look at or
+//	change the time, or switch threads.
+//----------------------------------------------------------------------
+
+void Machine::EndBurst()
+{
+	stats->totalTicks += burstRun * UserTick;
+	stats->userTicks += burstRun * UserTick;
+	burstRun = 0;
+	burstLeft = 0;
+}
+
+//----------------------------------------------------------------------
+// Machine::Profile
+// 	Count one execution of "instr", the instruction at the PC, for
+//	the profiler (see userprog/profile.h).  Only called when config
+//	includes ProfileConfig.
+//----------------------------------------------------------------------
+
+inline void
+Machine::Profile(Instruction *instr)
+{
+	unsigned int word = (unsigned)registers[PCReg] / 4;
+
+	if (profileOps == NULL)
+		return; // this address space isn't being profiled
+	if (word < profileWords)
+		profileCounts[word]++;
+	profileOps[instr->opCode]++;
+}
+
+//----------------------------------------------------------------------
+// Machine::EnableProfile
+// 	Have every instruction counted from now on; the kernel says
+//	where, in profileCounts and profileOps.  Must be called before
+//	Run(), which picks the engine.
+//----------------------------------------------------------------------
+
+void Machine::EnableProfile()
+{
+	ASSERT(MaxOpcode < NumOpcodes); // profileOps has NumOpcodes counts
+	config |= ProfileConfig;
+}
+
+//----------------------------------------------------------------------
+// Machine::EnableTrace
+// 	Record the execution of user programs in the UNIX file
+//	"fileName", from now until the machine is deleted.  This needs
+//	the instrumented (TraceConfig) simulation, so it must be called
+//	before Run().
+//----------------------------------------------------------------------
+
+void Machine::EnableTrace(char *fileName)
+{
+	trace = new TraceWriter(fileName, pageSize);
+	config |= TraceConfig;
+}
+
 //----------------------------------------------------------------------
 // Machine::Run
 // 	Simulate the execution of a user-level program on Nachos.
@@ -27,25 +133,90 @@ static void Mult(int a, int b, bool signedArith, int *hiPtr, int *loPtr);
 //
 //	This routine is re-entrant, in that it can be called multiple
 //	times concurrently -- one for each thread executing user code.
+//
+//	The engine doing the work is compiled for the features this run
+//	needs ("config", see machine.h), so it doesn't test for tracing
+//	or single stepping on every instruction unless they may be on.
 //----------------------------------------------------------------------
 
 void Machine::Run()
 {
-	Instruction *instr = new Instruction; // storage for decoded instruction
+	static void (Machine::*interpreters[NumConfigs])() = {
+		&Machine::RunInterpreter<0>, &Machine::RunInterpreter<1>,
+		&Machine::RunInterpreter<2>, &Machine::RunInterpreter<3>,
+		&Machine::RunInterpreter<4>, &Machine::RunInterpreter<5>,
+		&Machine::RunInterpreter<6>, &Machine::RunInterpreter<7>,
+		&Machine::RunInterpreter<8>, &Machine::RunInterpreter<9>,
+		&Machine::RunInterpreter<10>, &Machine::RunInterpreter<11>,
+		&Machine::RunInterpreter<12>, &Machine::RunInterpreter<13>,
+		&Machine::RunInterpreter<14>, &Machine::RunInterpreter<15>};
 
 	if (DebugIsEnabled('m'))
 		printf("Starting thread \"%s\" at time %d\n",
 			   currentThread->getName(), stats->totalTicks);
 	interrupt->setStatus(UserMode);
+	if (cpuNum >= 0)
+		LeaveKernel(cpuNum); // (see userprog/smp.h)
+	if (engine != InterpretEngine && !(config & (TraceConfig | StepConfig)))
+	{ // never return
+		switch (config & (TLBConfig | ProfileConfig))
+		{
+		case 0:
+			RunThreaded<0>();
+		case TLBConfig:
+			RunThreaded<TLBConfig>();
+		case ProfileConfig:
+			RunThreaded<ProfileConfig>();
+		default:
+			RunThreaded<TLBConfig | ProfileConfig>();
+		}
+	}
+	(this->*interpreters[config])(); // never returns
+}
+
+//----------------------------------------------------------------------
+// Machine::RunInterpreter
+// 	Execute a user program one OneInstruction at a time.  Called
+//	from Run(); never returns.
+//----------------------------------------------------------------------
+
+template <int Config>
+void Machine::RunInterpreter()
+{
 	for (;;)
 	{
-		OneInstruction(instr);
-		interrupt->OneTick();
-		if (singleStep && (runUntilTime <= stats->totalTicks))
+		OneInstruction<Config>();
+		Tick();
+		if ((Config & StepConfig) && singleStep &&
+			(runUntilTime <= stats->totalTicks))
 			Debugger();
 	}
 }
 
+//----------------------------------------------------------------------
+// OpcodeName
+// 	The mnemonic of a decoded opcode, as in the "m" debugging output,
+//	for the profiler, which doesn't see the tables in mipssim.h.
+//
+//	"opCode" -- the OP_ value
+//	"name" -- where to put the mnemonic, at most "maxLength" bytes
+//----------------------------------------------------------------------
+
+void
+OpcodeName(int opCode, char *name, int maxLength)
+{
+	char *format;
+	int length;
+
+	ASSERT(opCode >= 0 && opCode <= MaxOpcode);
+	format = opStrings[opCode].string;
+	length = strcspn(format, " ");
+	if (length >= maxLength)
+		length = maxLength - 1;
+	strncpy(name, format, length);
+	name[length] = '\0';
+}
+
 //----------------------------------------------------------------------
 // TypeToReg
 // 	Retrieve the register # referred to in an instruction.
@@ -69,6 +240,133 @@ TypeToReg(RegType reg, Instruction *instr)
 	}
 }
 
+//----------------------------------------------------------------------
+// Machine::FetchInstruction
+// 	Fetch the instruction at the current PC, and return it in decoded
+//	form.  Each word of physical memory has a decode slot, in the
+//	DecodedPage made the first time anything on its page is fetched;
+//	so an instruction is only decoded the first time it is fetched,
+//	and after that, fetching costs a translation and an array lookup.
+//
+//	The PC is still translated on every fetch (usually by a hit in
+//	the hostTLB), so that page faults, use bits and context switches
+//	behave exactly as before.  Slots
+//	are thrown away by InvalidateDecodedPage whenever their page
+//	is written.
+//
+// Returns:
+//	The decoded instruction, or NULL if the translation failed (in
+//	which case the exception has already been raised).
+//----------------------------------------------------------------------
+
+template <int Config>
+Instruction *
+Machine::FetchInstruction()
+{
+	int physAddr, physPage, slot;
+	ExceptionType exception;
+	DecodedPage *page;
+	Instruction *instr;
+	unsigned int pc = (unsigned)registers[PCReg];
+	HostTLBEntry *h = &hostTLB[(pc >> pageShift) & (HostTLBSize - 1)];
+
+	if ((pc & (~(pageSize - 1) | 3)) == h->readTag)
+	{
+		physAddr = (h->physPage << pageShift) + (pc & (pageSize - 1));
+		if (Config & TLBConfig)
+			counts->numTLBHits++; // as Translate would have
+	}
+	else
+	{
+		exception = Translate<Config>(registers[PCReg], &physAddr, 4, FALSE);
+		if (exception != NoException)
+		{
+			RaiseException(exception, registers[PCReg]);
+			return NULL;
+		}
+	}
+	physPage = physAddr >> pageShift;
+	page = decodedPages[physPage];
+	if (page == NULL)
+		page = NewDecodedPage(physPage);
+	slot = (physAddr & (pageSize - 1)) / 4;
+	instr = &page->instr[slot];
+	if (!page->valid[slot])
+	{
+		instr->value = WordToHost(*(unsigned int *)&mainMemory[physAddr]);
+		instr->Decode();
+		page->valid[slot] = TRUE;
+		if (!decodePageValid[physPage])
+		{
+			decodePageValid[physPage] = TRUE;
+			RevokeHostTLBWrite(physPage);
+		}
+	}
+	fetchedPage = physPage;
+	return instr;
+}
+
+//----------------------------------------------------------------------
+// Machine::NewDecodedPage
+// 	Make the decode slots for a physical page, all empty, the first
+//	time an instruction is fetched from it.  They are kept (and reused
+//	after InvalidateDecodedPage) until the machine is deleted.
+//
+//	"physPage" -- the physical page number
+//----------------------------------------------------------------------
+
+DecodedPage *
+Machine::NewDecodedPage(int physPage)
+{
+	DecodedPage *page = new DecodedPage;
+
+	page->instr = new Instruction[DecodeSlotsPerPage];
+	page->valid = new bool[DecodeSlotsPerPage];
+	page->blockAt = new TranslatedBlock *[DecodeSlotsPerPage];
+	page->heat = new unsigned char[DecodeSlotsPerPage];
+	for (int slot = 0; slot < DecodeSlotsPerPage; slot++)
+	{
+		page->valid[slot] = FALSE;
+		page->blockAt[slot] = NULL;
+		page->heat[slot] = 0;
+	}
+	decodedPages[physPage] = page;
+	return page;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecodedPage
+// 	Discard the pre-decoded instructions of a physical page, because
+//	its contents have changed.  Called by WriteMem, and by the kernel
+//	whenever it writes into mainMemory directly (eg, when loading a
+//	program).
+//
+//	"physPage" -- the physical page number that was modified
+//----------------------------------------------------------------------
+
+void Machine::InvalidateDecodedPage(int physPage)
+{
+	DecodedPage *page;
+
+	ASSERT((physPage >= 0) && (physPage < numPhysPages));
+	if (!decodePageValid[physPage])
+		return; // nothing was ever decoded here
+	page = decodedPages[physPage];
+	for (int slot = 0; slot < DecodeSlotsPerPage; slot++)
+	{
+		page->valid[slot] = FALSE;
+		page->heat[slot] = 0;
+		if (page->blockAt[slot] != NULL)
+		{ // blocks are only chained within a page, so
+		  // nothing elsewhere can still point at this one
+			delete page->blockAt[slot];
+			page->blockAt[slot] = NULL;
+		}
+	}
+	decodePageValid[physPage] = FALSE;
+	codeEpoch++; // tell the block engine to stop using any block
+}
+
 //----------------------------------------------------------------------
 // Machine::OneInstruction
 // 	Execute one instruction from a user-level program
@@ -92,20 +390,27 @@ TypeToReg(RegType reg, Instruction *instr)
 //	and the register set.
 //----------------------------------------------------------------------
 
-void Machine::OneInstruction(Instruction *instr)
+template <int Config>
+void Machine::OneInstruction()
 {
-	int raw;
+	enum { Mem = Config & (TraceConfig | TLBConfig) }; // all memory
+													   // access cares about
+	Instruction *instr;
 	int nextLoadReg = 0;
 	int nextLoadValue = 0; // record delayed load operation, to apply
 						   // in the future
 
 	// Fetch instruction
-	if (!machine->ReadMem(registers[PCReg], 4, &raw))
+	instr = FetchInstruction<Mem>();
+	if (instr == NULL)
 		return; // exception occurred
-	instr->value = raw;
-	instr->Decode();
+	counts->numInstrs[(int)instr->mix]++;
+	if (Config & ProfileConfig)
+		Profile(instr);
+	if ((Config & TraceConfig) && trace != NULL)
+		trace->Instruction(registers[PCReg]);
 
-	if (DebugIsEnabled('m'))
+	if ((Config & TraceConfig) && DebugIsEnabled('m'))
 	{
 		struct OpString *str = &opStrings[instr->opCode];
 
@@ -165,36 +470,54 @@ void Machine::OneInstruction(Instruction *instr)
 
 	case OP_BEQ:
 		if (registers[instr->rs] == registers[instr->rt])
+		{
 			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+			counts->numBranchesTaken++;
+		}
 		break;
 
 	case OP_BGEZAL:
 		registers[R31] = registers[NextPCReg] + 4;
 	case OP_BGEZ:
 		if (!(registers[instr->rs] & SIGN_BIT))
+		{
 			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+			counts->numBranchesTaken++;
+		}
 		break;
 
 	case OP_BGTZ:
 		if (registers[instr->rs] > 0)
+		{
 			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+			counts->numBranchesTaken++;
+		}
 		break;
 
 	case OP_BLEZ:
 		if (registers[instr->rs] <= 0)
+		{
 			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+			counts->numBranchesTaken++;
+		}
 		break;
 
 	case OP_BLTZAL:
 		registers[R31] = registers[NextPCReg] + 4;
 	case OP_BLTZ:
 		if (registers[instr->rs] & SIGN_BIT)
+		{
 			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+			counts->numBranchesTaken++;
+		}
 		break;
 
 	case OP_BNE:
 		if (registers[instr->rs] != registers[instr->rt])
+		{
 			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+			counts->numBranchesTaken++;
+		}
 		break;
 
 	case OP_DIV:
@@ -242,7 +565,7 @@ void Machine::OneInstruction(Instruction *instr)
 	case OP_LB:
 	case OP_LBU:
 		tmp = registers[instr->rs] + instr->extra;
-		if (!machine->ReadMem(tmp, 1, &value))
+		if (!ReadMem<Mem>(tmp, 1, &value))
 			return;
 
 		if ((value & 0x80) && (instr->opCode == OP_LB))
@@ -261,7 +584,7 @@ void Machine::OneInstruction(Instruction *instr)
 			RaiseException(AddressErrorException, tmp);
 			return;
 		}
-		if (!machine->ReadMem(tmp, 2, &value))
+		if (!ReadMem<Mem>(tmp, 2, &value))
 			return;
 
 		if ((value & 0x8000) && (instr->opCode == OP_LH))
@@ -273,7 +596,8 @@ void Machine::OneInstruction(Instruction *instr)
 		break;
 
 	case OP_LUI:
-		DEBUG('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
+		if (Config & TraceConfig)
+			DEBUG('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
 		registers[instr->rt] = instr->extra << 16;
 		break;
 
@@ -284,7 +608,7 @@ void Machine::OneInstruction(Instruction *instr)
 			RaiseException(AddressErrorException, tmp);
 			return;
 		}
-		if (!machine->ReadMem(tmp, 4, &value))
+		if (!ReadMem<Mem>(tmp, 4, &value))
 			return;
 		nextLoadReg = instr->rt;
 		nextLoadValue = value;
@@ -298,7 +622,7 @@ void Machine::OneInstruction(Instruction *instr)
 		// fail (I think) if the other cases are ever exercised.
 		ASSERT((tmp & 0x3) == 0);
 
-		if (!machine->ReadMem(tmp, 4, &value))
+		if (!ReadMem<Mem>(tmp, 4, &value))
 			return;
 		if (registers[LoadReg] == instr->rt)
 			nextLoadValue = registers[LoadValueReg];
@@ -330,7 +654,7 @@ void Machine::OneInstruction(Instruction *instr)
 		// fail (I think) if the other cases are ever exercised.
 		ASSERT((tmp & 0x3) == 0);
 
-		if (!machine->ReadMem(tmp, 4, &value))
+		if (!ReadMem<Mem>(tmp, 4, &value))
 			return;
 		if (registers[LoadReg] == instr->rt)
 			nextLoadValue = registers[LoadValueReg];
@@ -387,7 +711,7 @@ void Machine::OneInstruction(Instruction *instr)
 		break;
 
 	case OP_OR:
-		registers[instr->rd] = registers[instr->rs] | registers[instr->rs];
+		registers[instr->rd] = registers[instr->rs] | registers[instr->rt];
 		break;
 
 	case OP_ORI:
@@ -395,12 +719,12 @@ void Machine::OneInstruction(Instruction *instr)
 		break;
 
 	case OP_SB:
-		if (!machine->WriteMem((unsigned)(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
+		if (!WriteMem<Mem>((unsigned)(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
 			return;
 		break;
 
 	case OP_SH:
-		if (!machine->WriteMem((unsigned)(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
+		if (!WriteMem<Mem>((unsigned)(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
 			return;
 		break;
 
@@ -481,7 +805,7 @@ void Machine::OneInstruction(Instruction *instr)
 		break;
 
 	case OP_SW:
-		if (!machine->WriteMem((unsigned)(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
+		if (!WriteMem<Mem>((unsigned)(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
 			return;
 		break;
 
@@ -492,7 +816,7 @@ void Machine::OneInstruction(Instruction *instr)
 		// fail (I think) if the other cases are ever exercised.
 		ASSERT((tmp & 0x3) == 0);
 
-		if (!machine->ReadMem((tmp & ~0x3), 4, &value))
+		if (!ReadMem<Mem>((tmp & ~0x3), 4, &value))
 			return;
 		switch (tmp & 0x3)
 		{
@@ -512,7 +836,7 @@ void Machine::OneInstruction(Instruction *instr)
 											0xff);
 			break;
 		}
-		if (!machine->WriteMem((tmp & ~0x3), 4, value))
+		if (!WriteMem<Mem>((tmp & ~0x3), 4, value))
 			return;
 		break;
 
@@ -523,7 +847,7 @@ void Machine::OneInstruction(Instruction *instr)
 		// fail (I think) if the other cases are ever exercised.
 		ASSERT((tmp & 0x3) == 0);
 
-		if (!machine->ReadMem((tmp & ~0x3), 4, &value))
+		if (!ReadMem<Mem>((tmp & ~0x3), 4, &value))
 			return;
 		switch (tmp & 0x3)
 		{
@@ -540,7 +864,7 @@ void Machine::OneInstruction(Instruction *instr)
 			value = registers[instr->rt];
 			break;
 		} // end of switch (tmp & 0x3)
-		if (!machine->WriteMem((tmp & ~0x3), 4, value))
+		if (!WriteMem<Mem>((tmp & ~0x3), 4, value))
 			return;
 		break;
 
@@ -577,6 +901,705 @@ void Machine::OneInstruction(Instruction *instr)
 	registers[NextPCReg] = pcAfter;
 }
 
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	Execute a user program with the threaded engine.  Called from
+//	Run(); never returns.
+//
+//	The semantics are exactly those of OneInstruction, but instead
+//	of switching on instr->opCode, each decoded instruction remembers
+//	the address of the code that executes it (instr->handler), and
+//	every such piece of code ends by committing its results, advancing
+//	time, fetching the next instruction and jumping straight to that
+//	instruction's code ("direct threading").  This uses the gcc
+//	"labels as values" extension.
+//
+//	Like OneInstruction, nothing is cached across an exception or
+//	interrupt: all state lives in the registers and memory.
+//
+//	With the block engine, an instruction that has been reached
+//	HotBlockThreshold times gets a TranslatedBlock built starting
+//	there.  Inside a block, the next instruction is simply the next
+//	slot of its DecodedPage, so the PC is translated once per block rather
+//	than once per instruction; and when a block ends, the block that
+//	followed it last time (if on the same page) is entered directly.
+//	Every instruction still commits its results and advances time
+//	on its own, so delayed loads, branch delay slots and exceptions
+//	behave exactly as in the interpreter.  We leave the block, and go
+//	back to translating the PC, as soon as an exception or interrupt
+//	happens or any decoded code is discarded, since the kernel may
+//	have changed the page tables or the code itself.  Like the
+//	hostTLB, blocks skip translations, so they are not used when every
+//	translation must be seen (hostTLBEnabled is off).
+//----------------------------------------------------------------------
+
+template <int Config>
+void Machine::RunThreaded()
+{
+	static void *dispatch[MaxOpcode + 1] = {
+		&&bad, &&op_add, &&op_addi, &&op_addiu, &&op_addu, &&op_and,
+		&&op_andi, &&op_beq, &&op_bgez, &&op_bgezal, &&op_bgtz, &&op_blez,
+		&&op_bltz, &&op_bltzal, &&op_bne, &&bad, &&op_div, &&op_divu,
+		&&op_j, &&op_jal, &&op_jalr, &&op_jr, &&op_lb, &&op_lbu, &&op_lh,
+		&&op_lhu, &&op_lui, &&op_lw, &&op_lwl, &&op_lwr, &&bad, &&op_mfhi,
+		&&op_mflo, &&bad, &&op_mthi, &&op_mtlo, &&op_mult, &&op_multu,
+		&&op_nor, &&op_or, &&op_ori, &&bad, &&op_sb, &&op_sh, &&op_sll,
+		&&op_sllv, &&op_slt, &&op_slti, &&op_sltiu, &&op_sltu, &&op_sra,
+		&&op_srav, &&op_srl, &&op_srlv, &&op_sub, &&op_subu, &&op_sw,
+		&&op_swl, &&op_swr, &&op_xor, &&op_xori, &&op_syscall, &&op_illegal,
+		&&op_illegal};
+	enum { Mem = Config & TLBConfig }; // all memory access cares about
+	int *r = registers;
+	Instruction *instr;
+	int pcAfter, nextLoadReg, nextLoadValue;
+	int sum, diff, tmp, value;
+	unsigned int rs, rt, imm;
+
+	bool useBlocks = (engine == BlockEngine) && hostTLBEnabled;
+	TranslatedBlock *block = NULL, *prev; // block being executed
+	int remaining = 0;			 // instructions left in it
+	int blockPage = 0;			 // virtual page it was entered from
+	int seenHandled = 0, seenEpoch = 0; // to notice interrupts and
+										// discarded code
+	DecodedPage *page;
+	int slot, i;
+
+// Start executing instr, the instruction at the PC.
+#define ENTER()                                            \
+	pcAfter = r[NextPCReg] + 4;                            \
+	nextLoadReg = 0;                                       \
+	nextLoadValue = 0;                                     \
+	counts->numInstrs[(int)instr->mix]++;                  \
+	if (Config & ProfileConfig)                            \
+		Profile(instr);                                    \
+	goto *instr->handler
+
+// Go on to the next instruction: the next one in the block if we are
+// in one and nothing has happened, otherwise the one at the PC.  (With
+// a TLB, a fetch within a block counts as the hit it would have been.)
+#define DISPATCH()                                         \
+	if (--remaining > 0)                                   \
+	{                                                      \
+		if (seenHandled == interrupt->getNumHandled() &&   \
+			seenEpoch == codeEpoch)                        \
+		{                                                  \
+			instr++;                                       \
+			if (Mem & TLBConfig)                           \
+				counts->numTLBHits++;                      \
+			ENTER();                                       \
+		}                                                  \
+		block = NULL;                                      \
+		remaining = 0;                                     \
+	}                                                      \
+	if (useBlocks)                                         \
+		goto block_fetch;                                  \
+	instr = FetchInstruction<Mem>();                       \
+	if (instr == NULL)                                     \
+		goto trapped;                                      \
+	if (instr->handler == NULL)                            \
+		instr->handler = dispatch[(int)instr->opCode];     \
+	ENTER()
+
+// The instruction completed: do the delayed load, advance the program
+// counters and simulated time, and go on to the next instruction.
+#define NEXT()                                             \
+	r[r[LoadReg]] = r[LoadValueReg];                       \
+	r[LoadReg] = nextLoadReg;                              \
+	r[LoadValueReg] = nextLoadValue;                       \
+	r[0] = 0;                                              \
+	r[PrevPCReg] = r[PCReg];                               \
+	r[PCReg] = r[NextPCReg];                               \
+	r[NextPCReg] = pcAfter;                                \
+	Tick();                                                \
+	DISPATCH()
+
+// The instruction trapped to the kernel; time still advances.
+#define TRAP()                                             \
+	goto trapped
+
+	DISPATCH();
+
+trapped:
+	block = NULL; // the kernel ran; start over from the PC
+	remaining = 0;
+	Tick();
+	DISPATCH();
+
+block_fetch:
+	// Block engine: find (or build) the block at the PC.  First try
+	// the blocks that followed this one before; they are on the same
+	// page, which we know is still mapped the same way.  A block runs
+	// its instructions in order, so it can only be entered if the
+	// PC isn't in the delay slot of a branch that was taken.
+	prev = NULL;
+	if (r[NextPCReg] != r[PCReg] + 4)
+		block = NULL; // in a delay slot: run it on its own
+	else if (block != NULL)
+	{
+		if (seenHandled != interrupt->getNumHandled() || seenEpoch != codeEpoch)
+			block = NULL;
+		else
+		{
+			for (i = 0; i < 2; i++)
+				if (block->next[i] != NULL && block->nextPC[i] == r[PCReg])
+				{
+					block = block->next[i];
+					if (Mem & TLBConfig)
+						counts->numTLBHits++; // as FetchInstruction would
+					goto block_enter;
+				}
+			if ((unsigned)r[PCReg] >> pageShift == (unsigned)blockPage)
+				prev = block; // chain to whatever we find
+		}
+	}
+	instr = FetchInstruction<Mem>();
+	if (instr == NULL)
+		goto trapped;
+	block = NULL;
+	if (r[NextPCReg] == r[PCReg] + 4)
+	{ // not in a delay slot
+		page = decodedPages[fetchedPage];
+		slot = instr - page->instr;
+		block = page->blockAt[slot];
+		if (block == NULL && ++page->heat[slot] >= HotBlockThreshold)
+			block = TranslateBlock(fetchedPage, slot, dispatch);
+	}
+	if (block == NULL)
+	{ // run this one instruction on its own
+		if (instr->handler == NULL)
+			instr->handler = dispatch[(int)instr->opCode];
+		remaining = 1;
+		ENTER();
+	}
+	if (prev != NULL)
+	{ // remember the way from prev to here
+		i = (prev->next[0] == NULL) ? 0 : 1;
+		prev->nextPC[i] = r[PCReg];
+		prev->next[i] = block;
+	}
+	blockPage = (unsigned)r[PCReg] >> pageShift;
+
+block_enter:
+	seenHandled = interrupt->getNumHandled();
+	seenEpoch = codeEpoch;
+	instr = block->start;
+	remaining = block->length;
+	ENTER();
+
+op_add:
+	sum = r[instr->rs] + r[instr->rt];
+	if (!((r[instr->rs] ^ r[instr->rt]) & SIGN_BIT) &&
+		((r[instr->rs] ^ sum) & SIGN_BIT))
+	{
+		RaiseException(OverflowException, 0);
+		TRAP();
+	}
+	r[instr->rd] = sum;
+	NEXT();
+
+op_addi:
+	sum = r[instr->rs] + instr->extra;
+	if (!((r[instr->rs] ^ instr->extra) & SIGN_BIT) &&
+		((instr->extra ^ sum) & SIGN_BIT))
+	{
+		RaiseException(OverflowException, 0);
+		TRAP();
+	}
+	r[instr->rt] = sum;
+	NEXT();
+
+op_addiu:
+	r[instr->rt] = r[instr->rs] + instr->extra;
+	NEXT();
+
+op_addu:
+	r[instr->rd] = r[instr->rs] + r[instr->rt];
+	NEXT();
+
+op_and:
+	r[instr->rd] = r[instr->rs] & r[instr->rt];
+	NEXT();
+
+op_andi:
+	r[instr->rt] = r[instr->rs] & (instr->extra & 0xffff);
+	NEXT();
+
+op_beq:
+	if (r[instr->rs] == r[instr->rt])
+	{
+		pcAfter = r[NextPCReg] + IndexToAddr(instr->extra);
+		counts->numBranchesTaken++;
+	}
+	NEXT();
+
+op_bgezal:
+	r[R31] = r[NextPCReg] + 4;
+op_bgez:
+	if (!(r[instr->rs] & SIGN_BIT))
+	{
+		pcAfter = r[NextPCReg] + IndexToAddr(instr->extra);
+		counts->numBranchesTaken++;
+	}
+	NEXT();
+
+op_bgtz:
+	if (r[instr->rs] > 0)
+	{
+		pcAfter = r[NextPCReg] + IndexToAddr(instr->extra);
+		counts->numBranchesTaken++;
+	}
+	NEXT();
+
+op_blez:
+	if (r[instr->rs] <= 0)
+	{
+		pcAfter = r[NextPCReg] + IndexToAddr(instr->extra);
+		counts->numBranchesTaken++;
+	}
+	NEXT();
+
+op_bltzal:
+	r[R31] = r[NextPCReg] + 4;
+op_bltz:
+	if (r[instr->rs] & SIGN_BIT)
+	{
+		pcAfter = r[NextPCReg] + IndexToAddr(instr->extra);
+		counts->numBranchesTaken++;
+	}
+	NEXT();
+
+op_bne:
+	if (r[instr->rs] != r[instr->rt])
+	{
+		pcAfter = r[NextPCReg] + IndexToAddr(instr->extra);
+		counts->numBranchesTaken++;
+	}
+	NEXT();
+
+op_div:
+	if (r[instr->rt] == 0)
+	{
+		r[LoReg] = 0;
+		r[HiReg] = 0;
+	}
+	else
+	{
+		r[LoReg] = r[instr->rs] / r[instr->rt];
+		r[HiReg] = r[instr->rs] % r[instr->rt];
+	}
+	NEXT();
+
+op_divu:
+	rs = (unsigned int)r[instr->rs];
+	rt = (unsigned int)r[instr->rt];
+	if (rt == 0)
+	{
+		r[LoReg] = 0;
+		r[HiReg] = 0;
+	}
+	else
+	{
+		tmp = rs / rt;
+		r[LoReg] = (int)tmp;
+		tmp = rs % rt;
+		r[HiReg] = (int)tmp;
+	}
+	NEXT();
+
+op_jal:
+	r[R31] = r[NextPCReg] + 4;
+op_j:
+	pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
+	NEXT();
+
+op_jalr:
+	r[instr->rd] = r[NextPCReg] + 4;
+op_jr:
+	pcAfter = r[instr->rs];
+	NEXT();
+
+op_lb:
+op_lbu:
+	tmp = r[instr->rs] + instr->extra;
+	if (!ReadMem<Mem>(tmp, 1, &value))
+		TRAP();
+	if ((value & 0x80) && (instr->opCode == OP_LB))
+		value |= 0xffffff00;
+	else
+		value &= 0xff;
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	NEXT();
+
+op_lh:
+op_lhu:
+	tmp = r[instr->rs] + instr->extra;
+	if (tmp & 0x1)
+	{
+		RaiseException(AddressErrorException, tmp);
+		TRAP();
+	}
+	if (!ReadMem<Mem>(tmp, 2, &value))
+		TRAP();
+	if ((value & 0x8000) && (instr->opCode == OP_LH))
+		value |= 0xffff0000;
+	else
+		value &= 0xffff;
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	NEXT();
+
+op_lui:
+	r[instr->rt] = instr->extra << 16;
+	NEXT();
+
+op_lw:
+	tmp = r[instr->rs] + instr->extra;
+	if (tmp & 0x3)
+	{
+		RaiseException(AddressErrorException, tmp);
+		TRAP();
+	}
+	if (!ReadMem<Mem>(tmp, 4, &value))
+		TRAP();
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	NEXT();
+
+op_lwl:
+	tmp = r[instr->rs] + instr->extra;
+	ASSERT((tmp & 0x3) == 0); // see OneInstruction
+	if (!ReadMem<Mem>(tmp, 4, &value))
+		TRAP();
+	if (r[LoadReg] == instr->rt)
+		nextLoadValue = r[LoadValueReg];
+	else
+		nextLoadValue = r[instr->rt];
+	switch (tmp & 0x3)
+	{
+	case 0:
+		nextLoadValue = value;
+		break;
+	case 1:
+		nextLoadValue = (nextLoadValue & 0xff) | (value << 8);
+		break;
+	case 2:
+		nextLoadValue = (nextLoadValue & 0xffff) | (value << 16);
+		break;
+	case 3:
+		nextLoadValue = (nextLoadValue & 0xffffff) | (value << 24);
+		break;
+	}
+	nextLoadReg = instr->rt;
+	NEXT();
+
+op_lwr:
+	tmp = r[instr->rs] + instr->extra;
+	ASSERT((tmp & 0x3) == 0); // see OneInstruction
+	if (!ReadMem<Mem>(tmp, 4, &value))
+		TRAP();
+	if (r[LoadReg] == instr->rt)
+		nextLoadValue = r[LoadValueReg];
+	else
+		nextLoadValue = r[instr->rt];
+	switch (tmp & 0x3)
+	{
+	case 0:
+		nextLoadValue = (nextLoadValue & 0xffffff00) |
+						((value >> 24) & 0xff);
+		break;
+	case 1:
+		nextLoadValue = (nextLoadValue & 0xffff0000) |
+						((value >> 16) & 0xffff);
+		break;
+	case 2:
+		nextLoadValue = (nextLoadValue & 0xff000000) | ((value >> 8) & 0xffffff);
+		break;
+	case 3:
+		nextLoadValue = value;
+		break;
+	}
+	nextLoadReg = instr->rt;
+	NEXT();
+
+op_mfhi:
+	r[instr->rd] = r[HiReg];
+	NEXT();
+
+op_mflo:
+	r[instr->rd] = r[LoReg];
+	NEXT();
+
+op_mthi:
+	r[HiReg] = r[instr->rs];
+	NEXT();
+
+op_mtlo:
+	r[LoReg] = r[instr->rs];
+	NEXT();
+
+op_mult:
+	Mult(r[instr->rs], r[instr->rt], TRUE, &r[HiReg], &r[LoReg]);
+	NEXT();
+
+op_multu:
+	Mult(r[instr->rs], r[instr->rt], FALSE, &r[HiReg], &r[LoReg]);
+	NEXT();
+
+op_nor:
+	r[instr->rd] = ~(r[instr->rs] | r[instr->rt]);
+	NEXT();
+
+op_or:
+	r[instr->rd] = r[instr->rs] | r[instr->rt];
+	NEXT();
+
+op_ori:
+	r[instr->rt] = r[instr->rs] | (instr->extra & 0xffff);
+	NEXT();
+
+op_sb:
+	if (!WriteMem<Mem>((unsigned)(r[instr->rs] + instr->extra), 1, r[instr->rt]))
+		TRAP();
+	NEXT();
+
+op_sh:
+	if (!WriteMem<Mem>((unsigned)(r[instr->rs] + instr->extra), 2, r[instr->rt]))
+		TRAP();
+	NEXT();
+
+op_sll:
+	r[instr->rd] = r[instr->rt] << instr->extra;
+	NEXT();
+
+op_sllv:
+	r[instr->rd] = r[instr->rt] << (r[instr->rs] & 0x1f);
+	NEXT();
+
+op_slt:
+	r[instr->rd] = (r[instr->rs] < r[instr->rt]) ? 1 : 0;
+	NEXT();
+
+op_slti:
+	r[instr->rt] = (r[instr->rs] < instr->extra) ? 1 : 0;
+	NEXT();
+
+op_sltiu:
+	rs = r[instr->rs];
+	imm = instr->extra;
+	r[instr->rt] = (rs < imm) ? 1 : 0;
+	NEXT();
+
+op_sltu:
+	rs = r[instr->rs];
+	rt = r[instr->rt];
+	r[instr->rd] = (rs < rt) ? 1 : 0;
+	NEXT();
+
+op_sra:
+	r[instr->rd] = r[instr->rt] >> instr->extra;
+	NEXT();
+
+op_srav:
+	r[instr->rd] = r[instr->rt] >> (r[instr->rs] & 0x1f);
+	NEXT();
+
+op_srl:
+	tmp = r[instr->rt];
+	tmp >>= instr->extra;
+	r[instr->rd] = tmp;
+	NEXT();
+
+op_srlv:
+	tmp = r[instr->rt];
+	tmp >>= (r[instr->rs] & 0x1f);
+	r[instr->rd] = tmp;
+	NEXT();
+
+op_sub:
+	diff = r[instr->rs] - r[instr->rt];
+	if (((r[instr->rs] ^ r[instr->rt]) & SIGN_BIT) &&
+		((r[instr->rs] ^ diff) & SIGN_BIT))
+	{
+		RaiseException(OverflowException, 0);
+		TRAP();
+	}
+	r[instr->rd] = diff;
+	NEXT();
+
+op_subu:
+	r[instr->rd] = r[instr->rs] - r[instr->rt];
+	NEXT();
+
+op_sw:
+	if (!WriteMem<Mem>((unsigned)(r[instr->rs] + instr->extra), 4, r[instr->rt]))
+		TRAP();
+	NEXT();
+
+op_swl:
+	tmp = r[instr->rs] + instr->extra;
+	ASSERT((tmp & 0x3) == 0); // see OneInstruction
+	if (!ReadMem<Mem>((tmp & ~0x3), 4, &value))
+		TRAP();
+	switch (tmp & 0x3)
+	{
+	case 0:
+		value = r[instr->rt];
+		break;
+	case 1:
+		value = (value & 0xff000000) | ((r[instr->rt] >> 8) & 0xffffff);
+		break;
+	case 2:
+		value = (value & 0xffff0000) | ((r[instr->rt] >> 16) & 0xffff);
+		break;
+	case 3:
+		value = (value & 0xffffff00) | ((r[instr->rt] >> 24) & 0xff);
+		break;
+	}
+	if (!WriteMem<Mem>((tmp & ~0x3), 4, value))
+		TRAP();
+	NEXT();
+
+op_swr:
+	tmp = r[instr->rs] + instr->extra;
+	ASSERT((tmp & 0x3) == 0); // see OneInstruction
+	if (!ReadMem<Mem>((tmp & ~0x3), 4, &value))
+		TRAP();
+	switch (tmp & 0x3)
+	{
+	case 0:
+		value = (value & 0xffffff) | (r[instr->rt] << 24);
+		break;
+	case 1:
+		value = (value & 0xffff) | (r[instr->rt] << 16);
+		break;
+	case 2:
+		value = (value & 0xff) | (r[instr->rt] << 8);
+		break;
+	case 3:
+		value = r[instr->rt];
+		break;
+	}
+	if (!WriteMem<Mem>((tmp & ~0x3), 4, value))
+		TRAP();
+	NEXT();
+
+op_xor:
+	r[instr->rd] = r[instr->rs] ^ r[instr->rt];
+	NEXT();
+
+op_xori:
+	r[instr->rt] = r[instr->rs] ^ (instr->extra & 0xffff);
+	NEXT();
+
+op_syscall:
+	RaiseException(SyscallException, 0);
+	TRAP();
+
+op_illegal:
+	RaiseException(IllegalInstrException, 0);
+	TRAP();
+
+bad:
+	ASSERT(FALSE); // opcode OneInstruction doesn't know about either
+
+#undef ENTER
+#undef DISPATCH
+#undef NEXT
+#undef TRAP
+}
+
+//----------------------------------------------------------------------
+// EndsBlock
+// 	Return TRUE if an instruction is a branch or jump, so that a
+//	translated block has to end after its delay slot.
+//----------------------------------------------------------------------
+
+static bool
+EndsBlock(int opCode)
+{
+	switch (opCode)
+	{
+	case OP_BEQ:
+	case OP_BGEZ:
+	case OP_BGEZAL:
+	case OP_BGTZ:
+	case OP_BLEZ:
+	case OP_BLTZ:
+	case OP_BLTZAL:
+	case OP_BNE:
+	case OP_J:
+	case OP_JAL:
+	case OP_JALR:
+	case OP_JR:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslateBlock
+// 	Build the translated block that starts at a decode slot of a
+//	physical page, for the block engine.  The block extends up to and including the
+//	delay slot of the first branch or jump, but never off the end of
+//	the physical page.  (If it has to stop between a branch and its
+//	delay slot, the delay slot may start another block, running on
+//	into the code after it; so a block is only entered when the
+//	instruction before it wasn't a taken branch -- see block_fetch.)
+//	Every instruction in the block is decoded, and its handler filled in.
+//
+//	"physPage" -- the physical page the block is in
+//	"startSlot" -- the slot of its first instruction, within the page
+//	"handlers" -- the threaded engine's table of code for each opcode
+//
+// Returns:
+//	The new block, or NULL if there is nothing worth translating.
+//----------------------------------------------------------------------
+
+TranslatedBlock *
+Machine::TranslateBlock(int physPage, int startSlot, void **handlers)
+{
+	DecodedPage *page = decodedPages[physPage];
+	int slot, length = 0;
+	bool delaySlot = FALSE;
+	Instruction *instr;
+	TranslatedBlock *block;
+
+	for (slot = startSlot; slot < DecodeSlotsPerPage && length < MaxBlockLength;
+		 slot++)
+	{
+		instr = &page->instr[slot];
+		if (!page->valid[slot])
+		{
+			instr->value = WordToHost(*(unsigned int *)
+							&mainMemory[physPage * pageSize + slot * 4]);
+			instr->Decode();
+			page->valid[slot] = TRUE;
+		}
+		instr->handler = handlers[(int)instr->opCode];
+		length++;
+		if (delaySlot)
+			break;
+		if (instr->opCode == OP_SYSCALL || instr->opCode == OP_RES ||
+			instr->opCode == OP_UNIMP)
+			break;
+		delaySlot = EndsBlock(instr->opCode);
+	}
+	if (length <= 1)
+		return NULL;
+
+	block = new TranslatedBlock;
+	block->start = &page->instr[startSlot];
+	block->length = length;
+	block->next[0] = block->next[1] = NULL;
+	block->nextPC[0] = block->nextPC[1] = 0;
+	page->blockAt[startSlot] = block;
+	DEBUG('m', "Translated block at page %d slot %d, %d instructions\n",
+		  physPage, startSlot, length);
+	return block;
+}
+
 //----------------------------------------------------------------------
 // Machine::DelayedLoad
 // 	Simulate effects of a delayed load.
@@ -593,6 +1616,59 @@ void Machine::DelayedLoad(int nextReg, int nextValue)
 	registers[0] = 0; // and always make sure R0 stays zero.
 }
 
+//----------------------------------------------------------------------
+// ClassOf
+// 	The kind of instruction an opcode is, for the instruction mix
+//	counted in stats->numInstrs.
+//----------------------------------------------------------------------
+
+static InstrClass
+ClassOf(int opCode)
+{
+	switch (opCode)
+	{
+	case OP_BEQ:
+	case OP_BGEZ:
+	case OP_BGEZAL:
+	case OP_BGTZ:
+	case OP_BLEZ:
+	case OP_BLTZ:
+	case OP_BLTZAL:
+	case OP_BNE:
+		return BranchInstr;
+	case OP_J:
+	case OP_JAL:
+	case OP_JALR:
+	case OP_JR:
+		return JumpInstr;
+	case OP_LB:
+	case OP_LBU:
+		return LoadByteInstr;
+	case OP_LH:
+	case OP_LHU:
+		return LoadHalfInstr;
+	case OP_LW:
+	case OP_LWL:
+	case OP_LWR:
+		return LoadWordInstr;
+	case OP_SB:
+		return StoreByteInstr;
+	case OP_SH:
+		return StoreHalfInstr;
+	case OP_SW:
+	case OP_SWL:
+	case OP_SWR:
+		return StoreWordInstr;
+	case OP_SYSCALL:
+		return SyscallInstr;
+	case OP_RES:
+	case OP_UNIMP:
+		return OtherInstr;
+	default:
+		return ALUInstr;
+	}
+}
+
 //----------------------------------------------------------------------
 // Instruction::Decode
 // 	Decode a MIPS instruction
@@ -602,6 +1678,7 @@ void Instruction::Decode()
 {
 	OpInfo *opPtr;
 
+	handler = NULL;
 	rs = (value >> 21) & 0x1f;
 	rt = (value >> 16) & 0x1f;
 	rd = (value >> 11) & 0x1f;
@@ -652,6 +1729,7 @@ void Instruction::Decode()
 			opCode = OP_UNIMP;
 		}
 	}
+	mix = ClassOf(opCode);
 }
 
 //----------------------------------------------------------------------
@@ -0,0 +1,153 @@
+// pagetable.cc
+//	Routines to build two-level and inverted page tables.  The
+//	lookups, used by Machine::Translate, are in pagetable.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "pagetable.h"
+
+//----------------------------------------------------------------------
+// PageDirectory::PageDirectory
+// 	Create a two-level page table with nothing mapped yet.  Only the
+//	directory is allocated, one pointer per PageGroupSize pages.
+//
+//	"pages" -- the number of virtual pages it covers
+//----------------------------------------------------------------------
+
+PageDirectory::PageDirectory(unsigned int pages)
+{
+	int size = divRoundUp(pages, PageGroupSize);
+
+	numPages = pages;
+	directory = new TranslationEntry *[size];
+	for (int i = 0; i < size; i++)
+		directory[i] = NULL;
+	numGroups = 0;
+}
+
+//----------------------------------------------------------------------
+// PageDirectory::~PageDirectory
+// 	De-allocate the directory and the second-level tables.
+//----------------------------------------------------------------------
+
+PageDirectory::~PageDirectory()
+{
+	int size = divRoundUp(numPages, PageGroupSize);
+
+	for (int i = 0; i < size; i++)
+		delete[] directory[i];
+	delete[] directory;
+}
+
+//----------------------------------------------------------------------
+// PageDirectory::Map
+// 	Return the entry for virtual page "vpn", for the caller to fill
+//	in.  If no page near it was mapped before, its second-level
+//	table is allocated, with every entry invalid.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+PageDirectory::Map(unsigned int vpn)
+{
+	TranslationEntry **group;
+
+	ASSERT(vpn < numPages);
+	group = &directory[vpn >> PageGroupShift];
+	if (*group == NULL)
+	{
+		*group = new TranslationEntry[PageGroupSize];
+		for (int i = 0; i < PageGroupSize; i++)
+		{
+			(*group)[i].virtualPage = (vpn & ~(PageGroupSize - 1)) + i;
+			(*group)[i].valid = FALSE;
+		}
+		numGroups++;
+	}
+	return &(*group)[vpn & (PageGroupSize - 1)];
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::InvertedPageTable
+// 	Create an inverted page table with every physical page free.  The
+//	hash table has at least one chain per physical page, so chains
+//	stay short.
+//
+//	"numFrames" -- the number of physical pages
+//----------------------------------------------------------------------
+
+InvertedPageTable::InvertedPageTable(int numFrames)
+{
+	int numBuckets = 1;
+
+	while (numBuckets < numFrames)
+		numBuckets <<= 1;
+	bucketMask = numBuckets - 1;
+
+	frames = new TranslationEntry[numFrames];
+	owner = new int[numFrames];
+	next = new int[numFrames];
+	for (int i = 0; i < numFrames; i++)
+	{
+		frames[i].physicalPage = i;
+		frames[i].valid = FALSE;
+		owner[i] = -1;
+	}
+	buckets = new int[numBuckets];
+	for (int i = 0; i < numBuckets; i++)
+		buckets[i] = -1;
+}
+
+InvertedPageTable::~InvertedPageTable()
+{
+	delete[] frames;
+	delete[] owner;
+	delete[] next;
+	delete[] buckets;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Map
+// 	Record that physical page "frame" now holds virtual page "vpn" of
+//	address space "asid", and return its entry, valid and otherwise
+//	clear, for the caller to fill in the protection bits.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+InvertedPageTable::Map(int asid, unsigned int vpn, int frame)
+{
+	unsigned int bucket = Hash(asid, vpn);
+
+	ASSERT(owner[frame] == -1 && asid != -1);
+	ASSERT(Lookup(asid, vpn) == NULL); // each page is mapped just once
+	frames[frame].virtualPage = vpn;
+	frames[frame].physicalPage = frame;
+	frames[frame].valid = TRUE;
+	frames[frame].readOnly = FALSE;
+	frames[frame].use = FALSE;
+	frames[frame].dirty = FALSE;
+	owner[frame] = asid;
+	next[frame] = buckets[bucket];
+	buckets[bucket] = frame;
+	return &frames[frame];
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Unmap
+// 	Free physical page "frame", taking it off its hash chain.
+//----------------------------------------------------------------------
+
+void InvertedPageTable::Unmap(int frame)
+{
+	int *link;
+
+	ASSERT(owner[frame] != -1);
+	link = &buckets[Hash(owner[frame], frames[frame].virtualPage)];
+	while (*link != frame)
+		link = &next[*link];
+	*link = next[frame];
+	owner[frame] = -1;
+	frames[frame].valid = FALSE;
+}
@@ -0,0 +1,121 @@
+// pagetable.h
+//	Data structures for page tables that the machine can walk, other
+//	than a linear array of TranslationEntry indexed by virtual page #
+//	(see Machine::Translate).
+//
+//	A linear page table needs an entry for every page up to the
+//	highest one used, however sparse the address space.  The two
+//	organizations here cost memory in proportion to the pages
+//	actually mapped:
+//
+//	   PageDirectory -- a two-level radix table: a directory of
+//		pointers to small second-level tables, each mapping
+//		PageGroupSize consecutive virtual pages.  Second-level
+//		tables are only allocated for groups with a mapped page.
+//
+//	   InvertedPageTable -- a single table, shared by all address
+//		spaces, with one entry per physical page, recording which
+//		address space and virtual page it holds.  A hash table on
+//		<address space, virtual page #> finds the entry.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PAGETABLE_H
+#define PAGETABLE_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "translate.h"
+
+#define PageGroupShift 5					// log2(PageGroupSize)
+#define PageGroupSize (1 << PageGroupShift) // pages per second-level table
+
+// The following class defines a two-level page table, covering
+// virtual pages 0 .. numPages-1.
+
+class PageDirectory
+{
+public:
+	PageDirectory(unsigned int pages);    // Create an empty table
+	~PageDirectory();					  // De-allocate it, and every
+										  // second-level table
+
+	TranslationEntry *Lookup(unsigned int vpn);
+	// the entry for virtual page "vpn", or NULL
+	// if its second-level table doesn't exist
+	TranslationEntry *Map(unsigned int vpn);
+	// the entry for "vpn", allocating its
+	// second-level table (all invalid) if need be
+
+	unsigned int getNumPages() { return numPages; }
+	int getNumGroups() { return numGroups; } // second-level tables
+
+private:
+	TranslationEntry **directory; // one pointer per group of pages
+	unsigned int numPages;		  // # of virtual pages covered
+	int numGroups;				  // # of second-level tables allocated
+};
+
+// The following class defines an inverted page table, for a machine
+// with "numFrames" physical pages.  Address spaces are named by an
+// ASID (the kernel uses the SpaceId).  Each physical page can be
+// mapped by only one address space, at one virtual page.
+
+class InvertedPageTable
+{
+public:
+	InvertedPageTable(int numFrames); // Create an empty table
+	~InvertedPageTable();
+
+	TranslationEntry *Lookup(int asid, unsigned int vpn);
+	// the entry mapping virtual page "vpn" of
+	// "asid", or NULL if it isn't mapped
+	TranslationEntry *Map(int asid, unsigned int vpn, int frame);
+	// map "vpn" of "asid" to physical page
+	// "frame", and return the entry to fill in
+	void Unmap(int frame); // physical page "frame" is no longer mapped
+
+private:
+	TranslationEntry *frames; // what each physical page holds
+	int *owner;				  // the ASID of each, or -1 if free
+	int *next;				  // next frame on the same hash chain
+	int *buckets;			  // first frame on each hash chain, or -1
+	unsigned int bucketMask;  // # of hash chains - 1
+
+	unsigned int Hash(int asid, unsigned int vpn)
+	{
+		return ((vpn ^ ((unsigned)asid << 16)) * 2654435761U >> 8) & bucketMask;
+	}
+};
+
+//----------------------------------------------------------------------
+// PageDirectory::Lookup, InvertedPageTable::Lookup
+// 	Walk the table, as the hardware does on every memory access that
+//	isn't cached (hence inline).
+//----------------------------------------------------------------------
+
+inline TranslationEntry *
+PageDirectory::Lookup(unsigned int vpn)
+{
+	TranslationEntry *group;
+
+	if (vpn >= numPages)
+		return NULL;
+	group = directory[vpn >> PageGroupShift];
+	if (group == NULL)
+		return NULL;
+	return &group[vpn & (PageGroupSize - 1)];
+}
+
+inline TranslationEntry *
+InvertedPageTable::Lookup(int asid, unsigned int vpn)
+{
+	for (int i = buckets[Hash(asid, vpn)]; i != -1; i = next[i])
+		if (owner[i] == asid && (unsigned int)frames[i].virtualPage == vpn)
+			return &frames[i];
+	return NULL;
+}
+
+#endif // PAGETABLE_H
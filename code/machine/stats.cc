@@ -11,17 +11,230 @@
 #include "utility.h"
 #include "stats.h"
 
+// Names for the counts, as printed by Dump.  These must be in the
+// order of InstrClass above, and of ExceptionType in machine.h.
+
+static const char *instrClassNames[NumInstrClasses] = {
+    "alu", "branch", "jump", "load1", "load2", "load4",
+    "store1", "store2", "store4", "syscall", "other" };
+
+static const char *exceptionNames[MaxExceptionTypes] = {
+    "none", "syscall", "pagefault", "readonly", "buserror",
+    "addresserror", "overflow", "illegalinstr" };
+
+// The single counts, in the order they are checkpointed.
+
+static int Statistics::*scalarStats[] = {
+    &Statistics::totalTicks, &Statistics::idleTicks,
+    &Statistics::systemTicks, &Statistics::userTicks,
+    &Statistics::numDiskReads, &Statistics::numDiskWrites,
+    &Statistics::numConsoleCharsRead, &Statistics::numConsoleCharsWritten,
+    &Statistics::numPageFaults, &Statistics::numPacketsSent,
+    &Statistics::numPacketsRecvd, &Statistics::numBranchesTaken,
+    &Statistics::numTLBHits, &Statistics::numTLBMisses,
+    &Statistics::numJobsOnTime, &Statistics::numDeadlineMisses };
+
+#define NumScalarStats (int)(sizeof(scalarStats) / sizeof(scalarStats[0]))
+
+// The latency histograms, in the order they are printed.
+
+static Histogram Statistics::*latencyStats[] = {
+    &Statistics::diskLatency, &Statistics::diskWait,
+    &Statistics::syscallTime, &Statistics::readyWait,
+    &Statistics::mailLatency };
+
+#define NumLatencyStats (int)(sizeof(latencyStats) / sizeof(latencyStats[0]))
+
+//----------------------------------------------------------------------
+// Histogram::Histogram
+// 	Initialize an empty histogram (cf. henters and hprint, in
+//	bin/execute.c).
+//
+//	"histName" is what to call it in the output
+//----------------------------------------------------------------------
+
+Histogram::Histogram(const char *histName)
+{
+    name = histName;
+    for (int i = 0; i < HistogramBuckets; i++)
+	buckets[i] = 0;
+    overflow = total = 0;
+    max = 0;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Enter
+// 	Count one occurrence of the value "n".
+//----------------------------------------------------------------------
+
+void
+Histogram::Enter(int n)
+{
+    if (0 <= n && n < HistogramBuckets)
+	buckets[n]++;
+    else
+	overflow++;
+    total++;
+}
+
+//----------------------------------------------------------------------
+// Histogram::EnterLog
+// 	Count the number of bits in "value" (0 for 0, 1 for 1, 2 for 2
+//	or 3, 3 for 4..7, ...), so buckets hold ranges of sizes.
+//----------------------------------------------------------------------
+
+void
+Histogram::EnterLog(unsigned int value)
+{
+    int bits = 0;
+
+    if (value > max)
+	max = value;
+    while (value != 0) {
+	bits++;
+	value >>= 1;
+    }
+    Enter(bits);
+}
+
+//----------------------------------------------------------------------
+// Histogram::Percentile
+// 	Return the largest value in the bucket where the cumulative count
+//	reaches "percent"% of the values entered by EnterLog (or "max",
+//	if that is smaller).  So it is at least the "percent"th
+//	percentile, and less than twice it.
+//----------------------------------------------------------------------
+
+unsigned int
+Histogram::Percentile(int percent)
+{
+    int want = (int)(((double)total * percent + 99) / 100);
+    int sum = 0;
+    unsigned int top;
+
+    if (want < 1)
+	want = 1;
+    for (int i = 0; i < HistogramBuckets; i++) {
+	sum += buckets[i];
+	if (sum >= want) {
+	    top = (i == 0) ? 0 : (0xffffffff >> (32 - i)); // 2^i - 1
+	    return (top < max) ? top : max;
+	}
+    }
+    return max;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Print
+// 	Print each bucket that isn't empty: the value, the count, its
+//	percentage of the total, and the cumulative percentage.
+//----------------------------------------------------------------------
+
+void
+Histogram::Print()
+{
+    int sum = 0;
+
+    if (total == 0)
+	return;
+    printf("Histogram of %s:\n", name);
+    for (int i = 0; i < HistogramBuckets; i++) {
+	sum += buckets[i];
+	if (buckets[i] != 0)
+	    printf("\t%d\t%d\t%5.2f%%\t%5.2f%%\n", i, buckets[i],
+		100.0 * buckets[i] / total, 100.0 * sum / total);
+    }
+    if (overflow != 0)
+	printf("\toflo\t%d\t%5.2f%%\n", overflow, 100.0 * overflow / total);
+}
+
+//----------------------------------------------------------------------
+// Histogram::PrintPercentiles
+// 	Print the tail of a histogram kept by EnterLog, on one line.
+//----------------------------------------------------------------------
+
+void
+Histogram::PrintPercentiles()
+{
+    if (total == 0)
+	return;
+    printf("\t%s: count %d, p50 %u, p90 %u, p99 %u, max %u\n", name,
+	total, Percentile(50), Percentile(90), Percentile(99), max);
+}
+
+//----------------------------------------------------------------------
+// Histogram::Dump
+// 	Write the histogram as "<name>.<bucket> <count>" lines.
+//----------------------------------------------------------------------
+
+void
+Histogram::Dump(FILE *f)
+{
+    for (int i = 0; i < HistogramBuckets; i++)
+	if (buckets[i] != 0)
+	    fprintf(f, "%s.%d %d\n", name, i, buckets[i]);
+    fprintf(f, "%s.oflo %d\n", name, overflow);
+}
+
+void
+Histogram::DumpPercentiles(FILE *f)
+{
+    fprintf(f, "%s.p50 %u\n", name, Percentile(50));
+    fprintf(f, "%s.p90 %u\n", name, Percentile(90));
+    fprintf(f, "%s.p99 %u\n", name, Percentile(99));
+    fprintf(f, "%s.max %u\n", name, max);
+}
+
+//----------------------------------------------------------------------
+// Histogram::Checkpoint, Histogram::Restore
+// 	Write the counts to the open UNIX file "fd", or read them back,
+//	as part of a checkpoint (see Statistics::Checkpoint).
+//----------------------------------------------------------------------
+
+void
+Histogram::Checkpoint(int fd)
+{
+    WriteFile(fd, (char *)buckets, sizeof(buckets));
+    WriteFile(fd, (char *)&overflow, sizeof(int));
+    WriteFile(fd, (char *)&total, sizeof(int));
+    WriteFile(fd, (char *)&max, sizeof(int));
+}
+
+void
+Histogram::Restore(int fd)
+{
+    Read(fd, (char *)buckets, sizeof(buckets));
+    Read(fd, (char *)&overflow, sizeof(int));
+    Read(fd, (char *)&total, sizeof(int));
+    Read(fd, (char *)&max, sizeof(int));
+}
+
 //----------------------------------------------------------------------
 // Statistics::Statistics
 // 	Initialize performance metrics to zero, at system startup.
 //----------------------------------------------------------------------
 
 Statistics::Statistics()
+    : syscallCodes("syscalls"), userRuns("userruns"),
+      diskLatency("disklatency"), diskWait("diskwait"),
+      syscallTime("syscalltime"), readyWait("readywait"),
+      mailLatency("maillatency")
 {
+    int i;
+
     totalTicks = idleTicks = systemTicks = userTicks = 0;
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    for (i = 0; i < NumInstrClasses; i++)
+	numInstrs[i] = 0;
+    numBranchesTaken = 0;
+    for (i = 0; i < MaxExceptionTypes; i++)
+	numExceptions[i] = 0;
+    numTLBHits = numTLBMisses = 0;
+    numJobsOnTime = numDeadlineMisses = 0;
+    numStacksMade = numStacksReused = numStacksUnmapped = 0;
+    dumpFile = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -33,6 +246,8 @@ Statistics::Statistics()
 void
 Statistics::Print()
 {
+    FILE *f;
+
     printf("Ticks: total %d, idle %d, system %d, user %d\n", totalTicks, 
 	idleTicks, systemTicks, userTicks);
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
@@ -41,4 +256,144 @@ Statistics::Print()
     printf("Paging: faults %d\n", numPageFaults);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
+    printf("User instructions: ALU %d, branches %d (taken %d, not taken %d), "
+	"jumps %d, syscalls %d, other %d\n", numInstrs[ALUInstr],
+	numInstrs[BranchInstr], numBranchesTaken,
+	numInstrs[BranchInstr] - numBranchesTaken, numInstrs[JumpInstr],
+	numInstrs[SyscallInstr], numInstrs[OtherInstr]);
+    printf("Memory: loads %d/%d/%d, stores %d/%d/%d (bytes/halves/words)\n",
+	numInstrs[LoadByteInstr], numInstrs[LoadHalfInstr],
+	numInstrs[LoadWordInstr], numInstrs[StoreByteInstr],
+	numInstrs[StoreHalfInstr], numInstrs[StoreWordInstr]);
+    printf("Exceptions:");
+    for (int i = 1; i < MaxExceptionTypes; i++)
+	printf(" %s %d", exceptionNames[i], numExceptions[i]);
+    printf("\n");
+    printf("TLB: hits %d, misses %d\n", numTLBHits, numTLBMisses);
+    if (numJobsOnTime + numDeadlineMisses != 0)
+	printf("Real-time jobs: on time %d, deadlines missed %d\n",
+	    numJobsOnTime, numDeadlineMisses);
+    if (numStacksReused + numStacksUnmapped != 0)
+	printf("Thread stacks: made %d, reused %d, unmapped %d\n",
+	    numStacksMade, numStacksReused, numStacksUnmapped);
+    syscallCodes.Print();
+    userRuns.Print();
+    if (diskLatency.total + diskWait.total + syscallTime.total +
+	readyWait.total + mailLatency.total != 0) {
+	printf("Latencies, in ticks (percentiles to within a factor of 2):\n");
+	for (int i = 0; i < NumLatencyStats; i++)
+	    (this->*latencyStats[i]).PrintPercentiles();
+    }
+
+    if (dumpFile != NULL) {
+	if ((f = fopen(dumpFile, "w")) == NULL)
+	    printf("Unable to write statistics to %s\n", dumpFile);
+	else {
+	    Dump(f);
+	    fclose(f);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::Dump
+// 	Write every statistic to "f", one "name value" pair per line,
+//	for other programs to read.
+//----------------------------------------------------------------------
+
+void
+Statistics::Dump(FILE *f)
+{
+    int i;
+
+    fprintf(f, "ticks.total %d\n", totalTicks);
+    fprintf(f, "ticks.idle %d\n", idleTicks);
+    fprintf(f, "ticks.system %d\n", systemTicks);
+    fprintf(f, "ticks.user %d\n", userTicks);
+    fprintf(f, "disk.reads %d\n", numDiskReads);
+    fprintf(f, "disk.writes %d\n", numDiskWrites);
+    fprintf(f, "console.reads %d\n", numConsoleCharsRead);
+    fprintf(f, "console.writes %d\n", numConsoleCharsWritten);
+    fprintf(f, "paging.faults %d\n", numPageFaults);
+    fprintf(f, "network.received %d\n", numPacketsRecvd);
+    fprintf(f, "network.sent %d\n", numPacketsSent);
+    for (i = 0; i < NumInstrClasses; i++)
+	fprintf(f, "instrs.%s %d\n", instrClassNames[i], numInstrs[i]);
+    fprintf(f, "instrs.branch.taken %d\n", numBranchesTaken);
+    for (i = 0; i < MaxExceptionTypes; i++)
+	fprintf(f, "exceptions.%s %d\n", exceptionNames[i], numExceptions[i]);
+    fprintf(f, "tlb.hits %d\n", numTLBHits);
+    fprintf(f, "tlb.misses %d\n", numTLBMisses);
+    fprintf(f, "realtime.ontime %d\n", numJobsOnTime);
+    fprintf(f, "realtime.missed %d\n", numDeadlineMisses);
+    fprintf(f, "stacks.made %d\n", numStacksMade);
+    fprintf(f, "stacks.reused %d\n", numStacksReused);
+    fprintf(f, "stacks.unmapped %d\n", numStacksUnmapped);
+    syscallCodes.Dump(f);
+    userRuns.Dump(f);
+    for (i = 0; i < NumLatencyStats; i++) {
+	(this->*latencyStats[i]).Dump(f);
+	(this->*latencyStats[i]).DumpPercentiles(f);
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::Checkpoint
+// 	Write every count to the open UNIX file "fd", so that a run
+//	restored from a checkpoint carries on counting from here.
+//----------------------------------------------------------------------
+
+void
+Statistics::Checkpoint(int fd)
+{
+    for (int i = 0; i < NumScalarStats; i++)
+	WriteFile(fd, (char *)&(this->*scalarStats[i]), sizeof(int));
+    WriteFile(fd, (char *)numInstrs, sizeof(numInstrs));
+    WriteFile(fd, (char *)numExceptions, sizeof(numExceptions));
+    syscallCodes.Checkpoint(fd);
+    userRuns.Checkpoint(fd);
+    for (int i = 0; i < NumLatencyStats; i++)
+	(this->*latencyStats[i]).Checkpoint(fd);
+}
+
+//----------------------------------------------------------------------
+// Statistics::Restore
+// 	Read back the counts written by Checkpoint.  Where to dump them
+//	is left as this run was told.
+//----------------------------------------------------------------------
+
+void
+Statistics::Restore(int fd)
+{
+    for (int i = 0; i < NumScalarStats; i++)
+	Read(fd, (char *)&(this->*scalarStats[i]), sizeof(int));
+    Read(fd, (char *)numInstrs, sizeof(numInstrs));
+    Read(fd, (char *)numExceptions, sizeof(numExceptions));
+    syscallCodes.Restore(fd);
+    userRuns.Restore(fd);
+    for (int i = 0; i < NumLatencyStats; i++)
+	(this->*latencyStats[i]).Restore(fd);
+}
+
+//----------------------------------------------------------------------
+// Statistics::TakeCounts
+// 	Add the counts that a CPU keeps as it runs user instructions --
+//	of instructions, taken branches and TLB lookups -- to these, and
+//	zero them in "cpuCounts".  With more than one CPU, each keeps
+//	its own, so that CPUs running at once don't share a counter, and
+//	hands them over when it enters the kernel.
+//----------------------------------------------------------------------
+
+void
+Statistics::TakeCounts(Statistics *cpuCounts)
+{
+    for (int i = 0; i < NumInstrClasses; i++) {
+	numInstrs[i] += cpuCounts->numInstrs[i];
+	cpuCounts->numInstrs[i] = 0;
+    }
+    numBranchesTaken += cpuCounts->numBranchesTaken;
+    numTLBHits += cpuCounts->numTLBHits;
+    numTLBMisses += cpuCounts->numTLBMisses;
+    cpuCounts->numBranchesTaken = 0;
+    cpuCounts->numTLBHits = cpuCounts->numTLBMisses = 0;
 }
@@ -12,6 +12,64 @@
 #define STATS_H
 
 #include "copyright.h"
+#include <stdio.h>
+
+// The kinds of user instructions counted in Statistics::numInstrs.
+// (A conditional branch counts in numBranchesTaken as well, if taken.)
+
+enum InstrClass {
+    ALUInstr,			// arithmetic, logic, shifts, moves,
+				// multiply and divide
+    BranchInstr,		// conditional branches
+    JumpInstr,			// jumps, calls and returns
+    LoadByteInstr,		// loads, by size of access
+    LoadHalfInstr,
+    LoadWordInstr,
+    StoreByteInstr,		// stores, by size of access
+    StoreHalfInstr,
+    StoreWordInstr,
+    SyscallInstr,		// system calls
+    OtherInstr,			// reserved and unimplemented opcodes
+    NumInstrClasses
+};
+
+#define MaxExceptionTypes 8	// # of ExceptionTypes counted (cf.
+				// NumExceptionTypes in machine.h)
+#define HistogramBuckets 33	// values 0..32 (eg, log2 of an int)
+
+// The following class defines a histogram of small non-negative
+// integers, kept by Enter, with anything too big counted as overflow.
+// Print shows each bucket's count, its percentage of the total and
+// the cumulative percentage.
+//
+// Kept by EnterLog instead, it is a histogram of the sizes of values,
+// such as latencies, whose tail can be summarized by percentiles.
+// These are only known to within a factor of 2: Percentile gives the
+// largest value in the bucket the percentile falls in.
+
+class Histogram {
+  public:
+    Histogram(const char *histName); // initialize an empty histogram
+
+    void Enter(int n);		// count one occurrence of "n"
+    void EnterLog(unsigned int value); // count log2 of "value" (the
+				// number of bits it takes, 0 for 0)
+    unsigned int Percentile(int percent); // a value at least as big as
+				// "percent"% of those entered by EnterLog
+    void Print();		// print it, if anything was counted
+    void PrintPercentiles();	// print p50/p90/p99/max, if anything was
+				// counted by EnterLog
+    void Dump(FILE *f);		// write it as "name bucket count" lines
+    void DumpPercentiles(FILE *f); // and p50/p90/p99/max, as "name.p50"...
+    void Checkpoint(int fd);	// save the counts to a UNIX file
+    void Restore(int fd);	// and read them back
+
+    const char *name;
+    int buckets[HistogramBuckets];
+    int overflow;		// entries too big for a bucket
+    int total;			// all entries
+    unsigned int max;		// the largest value given to EnterLog
+};
 
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
@@ -36,9 +94,51 @@ class Statistics {
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 
+    int numInstrs[NumInstrClasses]; // user instructions of each kind
+				// (see InstrClass), including any that
+				// trapped and were restarted
+    int numBranchesTaken;	// conditional branches that were taken
+    int numExceptions[MaxExceptionTypes]; // traps to the kernel, by
+				// ExceptionType (syscalls included)
+    int numTLBHits;		// translations found in the TLB
+    int numTLBMisses;		// and not (if there is a TLB)
+    int numJobsOnTime;		// jobs of real-time threads done by
+    int numDeadlineMisses;	// their deadlines, and not
+    int numStacksMade;		// thread stacks mapped from the host,
+    int numStacksReused;	// taken from the pool of old ones, and
+    int numStacksUnmapped;	// unmapped, the pool being full (these
+				// three concern the host, so aren't
+				// checkpointed)
+
+    Histogram syscallCodes;	// system call codes (r2) used
+    Histogram userRuns;		// log2 of the # of user instructions
+				// run between traps to the kernel
+
+				// latencies, in ticks, kept by EnterLog:
+    Histogram diskLatency;	// disk requests, from when they are made
+				// until the kernel hears they're done
+    Histogram diskWait;		// SynchDisk reads and writes, including
+				// waiting for the disk to be free
+    Histogram syscallTime;	// system calls, including any time the
+				// caller is blocked (except Exit, Halt)
+    Histogram readyWait;	// threads on the ready list, until run
+    Histogram mailLatency;	// messages, from arrival off the network
+				// until taken out of their mailbox
+
+    char *dumpFile;		// if not NULL, Print also writes all of
+				// the above here, one "name value" per line
+
     Statistics(); 		// initialize everything to zero
 
     void Print();		// print collected statistics
+    void Dump(FILE *f);		// write them in machine-readable form
+
+    void Checkpoint(int fd);	// save all the counts (not dumpFile)
+    void Restore(int fd);	// to a UNIX file, and read them back
+
+    void TakeCounts(Statistics *cpuCounts); // add the user instruction
+				// and TLB counts a CPU kept on its own, and
+				// zero them (see userprog/smp.h)
 };
 
 // Constants used to reflect the relative time an operation would
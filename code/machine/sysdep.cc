@@ -36,6 +36,7 @@ extern "C" {
 #include <sys/un.h>
 #include <sys/mman.h>
 #include <sys/errno.h>
+#include <pthread.h>
 #ifdef HOST_i386
 #include <sys/time.h>
 #endif
@@ -450,6 +451,21 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostSeconds
+// 	Return the time of day on the host, in seconds (to the
+//	microsecond), for measuring how long the simulation itself takes.
+//----------------------------------------------------------------------
+
+double
+HostSeconds()
+{
+    struct timeval tv;
+
+    (void) gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -502,25 +518,32 @@ Random()
 //	the end of the array.  Particularly useful for catching overflow
 //	beyond fixed-size thread execution stacks.
 //
+//	The array is mapped from the host's virtual memory (see MapMemory),
+//	so each page of it only takes up host memory once it is used: a
+//	thread stack costs what the thread actually puts on it.
+//
 //	Note: Just return the useful part!
 //
-//	"size" -- amount of useful space needed (in bytes)
+//	"size" -- amount of useful space needed (in bytes), rounded up
+//		to a whole number of pages
 //----------------------------------------------------------------------
 
 char * 
 AllocBoundedArray(int size)
 {
     int pgSize = getpagesize();
-    char *ptr = new char[pgSize * 2 + size];
+    int rounded = divRoundUp(size, pgSize) * pgSize;
+    char *ptr = MapMemory(NULL, pgSize * 2 + rounded);
 
-    mprotect(ptr, pgSize, 0);
-    mprotect(ptr + pgSize + size, pgSize, 0);
+    mprotect(ptr, pgSize, PROT_NONE);
+    mprotect(ptr + pgSize + rounded, pgSize, PROT_NONE);
     return ptr + pgSize;
 }
 
 //----------------------------------------------------------------------
 // DeallocBoundedArray
-// 	Deallocate an array of integers, unprotecting its two boundary pages.
+// 	Deallocate an array made by AllocBoundedArray, with its two
+//	boundary pages.
 //
 //	"ptr" -- the array to be deallocated
 //	"size" -- amount of useful space in the array (in bytes)
@@ -531,7 +554,179 @@ DeallocBoundedArray(char *ptr, int size)
 {
     int pgSize = getpagesize();
 
-    mprotect(ptr - pgSize, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
-    mprotect(ptr + size, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
-    delete [] (ptr - pgSize);
+    UnmapMemory(ptr - pgSize, pgSize * 2 + divRoundUp(size, pgSize) * pgSize);
+}
+
+//----------------------------------------------------------------------
+// DiscardBoundedArray
+// 	Let the host have back the pages of an array made by
+//	AllocBoundedArray, which is to be kept for later use: it stays
+//	mapped, with its boundary pages, but costs no host memory until
+//	it is touched again, when it reads as zeroes.
+//
+//	"ptr" -- the array
+//	"size" -- amount of useful space in the array (in bytes)
+//----------------------------------------------------------------------
+
+void 
+DiscardBoundedArray(char *ptr, int size)
+{
+#ifdef MADV_DONTNEED
+    int pgSize = getpagesize();
+
+    madvise(ptr, divRoundUp(size, pgSize) * pgSize, MADV_DONTNEED);
+#endif
+}
+
+//----------------------------------------------------------------------
+// MapMemory
+// 	Return a zero-filled array, mapped straight from the host's
+//	virtual memory, so that the array costs nothing to create, and
+//	each page of it only takes up host memory once it is used (nor
+//	is swap space set aside for the rest).
+//
+//	If "name" is non-NULL, the array is the contents of that UNIX
+//	file instead, so that it starts out with whatever the file held,
+//	and whatever is written to it ends up in the file.  The file is
+//	created, or extended with zeroes, if it is too short.
+//
+//	"name" -- the file to keep the array in, or NULL
+//	"size" -- the size of the array (in bytes)
+//----------------------------------------------------------------------
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+char *
+MapMemory(char *name, long size)
+{
+    char *ptr;
+    int fd;
+
+    if (name == NULL)
+	ptr = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    else {
+	fd = open(name, O_RDWR|O_CREAT, 0666);
+	ASSERT(fd >= 0);
+	if (lseek(fd, 0, SEEK_END) < size) {
+	    int retVal = ftruncate(fd, size);
+	    ASSERT(retVal == 0);
+	}
+	ptr = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
+	close(fd);		// the mapping keeps the file open
+    }
+    ASSERT(ptr != (char *) MAP_FAILED);
+    return ptr;
+}
+
+//----------------------------------------------------------------------
+// UnmapMemory
+// 	Give back an array made by MapMemory.  If it was kept in a file,
+//	the file is left holding its final contents.
+//
+//	"ptr" -- the array
+//	"size" -- its size (in bytes)
+//----------------------------------------------------------------------
+
+void
+UnmapMemory(char *ptr, long size)
+{
+    munmap(ptr, size);
+}
+
+//----------------------------------------------------------------------
+// StartHostThread
+// 	Run (*func)(arg) on a new host thread, at the same time as the
+//	caller, for simulating more than one CPU.  The thread has a host
+//	stack of its own, and runs until Nachos exits.
+//----------------------------------------------------------------------
+
+struct HostThreadStart {
+    VoidFunctionPtr func;
+    _int arg;
+};
+
+static void *
+HostThreadRoot(void *p)
+{
+    HostThreadStart start = *(HostThreadStart *) p;
+
+    delete (HostThreadStart *) p;
+    (*start.func)(start.arg);
+    return NULL;
+}
+
+void
+StartHostThread(VoidFunctionPtr func, _int arg)
+{
+    HostThreadStart *start = new HostThreadStart;
+    pthread_t thread;
+
+    start->func = func;
+    start->arg = arg;
+    int retVal = pthread_create(&thread, NULL, HostThreadRoot, start);
+    ASSERT(retVal == 0);
+    pthread_detach(thread);
+}
+
+//----------------------------------------------------------------------
+// NewHostLock, HostLockAcquire, HostLockRelease
+// 	A lock between host threads: only one can hold it at a time.
+//	Unlike a Nachos Lock, waiting for it blocks the host thread.
+//----------------------------------------------------------------------
+
+void *
+NewHostLock()
+{
+    pthread_mutex_t *lock = new pthread_mutex_t;
+
+    pthread_mutex_init(lock, NULL);
+    return (void *) lock;
+}
+
+void
+HostLockAcquire(void *lock)
+{
+    pthread_mutex_lock((pthread_mutex_t *) lock);
+}
+
+void
+HostLockRelease(void *lock)
+{
+    pthread_mutex_unlock((pthread_mutex_t *) lock);
+}
+
+//----------------------------------------------------------------------
+// NewHostCondition, HostConditionWait, HostConditionSignal
+// 	A condition variable between host threads.  Wait gives up "lock"
+//	(which the caller holds), blocks until signalled, and takes the
+//	lock back before returning; it may also return without a signal,
+//	so the caller must check again for what it is waiting for.
+//----------------------------------------------------------------------
+
+void *
+NewHostCondition()
+{
+    pthread_cond_t *cond = new pthread_cond_t;
+
+    pthread_cond_init(cond, NULL);
+    return (void *) cond;
+}
+
+void
+HostConditionWait(void *cond, void *lock)
+{
+    pthread_cond_wait((pthread_cond_t *) cond, (pthread_mutex_t *) lock);
+}
+
+void
+HostConditionSignal(void *cond)
+{
+    pthread_cond_signal((pthread_cond_t *) cond);
 }
@@ -44,6 +44,9 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 
+// The host's clock, in seconds
+extern double HostSeconds();
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
 
@@ -55,6 +58,24 @@ extern int Random();
 // just beyond either end of the array will cause an error
 extern char *AllocBoundedArray(int size);
 extern void DeallocBoundedArray(char *p, int size);
+// Give the host back the memory behind such an array, which stays
+// mapped (and reads as zeroes) until it is next used
+extern void DiscardBoundedArray(char *p, int size);
+
+// Map, unmap a large zero-filled array, whose pages the host only
+// allocates when they are first used; optionally kept in a file
+extern char *MapMemory(char *name, long size);
+extern void UnmapMemory(char *p, long size);
+
+// Host threads, and locks and condition variables between them, for
+// simulating more than one CPU at once
+extern void StartHostThread(VoidFunctionPtr func, _int arg);
+extern void *NewHostLock();
+extern void HostLockAcquire(void *lock);
+extern void HostLockRelease(void *lock);
+extern void *NewHostCondition();
+extern void HostConditionWait(void *cond, void *lock);
+extern void HostConditionSignal(void *cond);
 
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
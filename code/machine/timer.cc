@@ -39,17 +39,48 @@ static void TimerHandler(_int arg)
 //      "callArg" is the parameter to be passed to the interrupt handler.
 //      "doRandom" -- if true, arrange for the interrupts to occur
 //		at random, instead of fixed, intervals.
+//      "startStopped" -- if true, don't interrupt until Start is called.
 //----------------------------------------------------------------------
 
-Timer::Timer(VoidFunctionPtr timerHandler, _int callArg, bool doRandom)
+Timer::Timer(VoidFunctionPtr timerHandler, _int callArg, bool doRandom,
+	     bool startStopped)
 {
     randomize = doRandom;
     handler = timerHandler;
     arg = callArg; 
+    onDemand = startStopped;
 
     // schedule the first interrupt from the timer device
-    interrupt->Schedule(TimerHandler, (_int) this, TimeOfNextInterrupt(), 
-		TimerInt); 
+    if (!startStopped)
+	Start();
+}
+
+//----------------------------------------------------------------------
+// Timer::Start
+//      Start the timer, if it isn't running: the first interrupt comes
+//	one time slice from now.
+//----------------------------------------------------------------------
+
+void
+Timer::Start()
+{
+    if (!next.IsSet())
+	next = interrupt->Schedule(TimerHandler, (_int) this,
+		TimeOfNextInterrupt(), TimerInt);
+}
+
+//----------------------------------------------------------------------
+// Timer::Stop
+//      Stop the timer, if it is running, calling off its next interrupt.
+//----------------------------------------------------------------------
+
+void
+Timer::Stop()
+{
+    if (next.IsSet()) {
+	interrupt->Cancel(next);
+	next = IntHandle();
+    }
 }
 
 //----------------------------------------------------------------------
@@ -62,8 +93,8 @@ void
 Timer::TimerExpired() 
 {
     // schedule the next timer device interrupt
-    interrupt->Schedule(TimerHandler, (_int) this, TimeOfNextInterrupt(), 
-		TimerInt);
+    next = interrupt->Schedule(TimerHandler, (_int) this,
+		TimeOfNextInterrupt(), TimerInt);
 
     // invoke the Nachos interrupt handler for this device
     (*handler)(arg);
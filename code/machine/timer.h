@@ -11,6 +11,11 @@
 //	In order to introduce some randomness into time-slicing, if "doRandom"
 //	is set, then the interrupt comes after a random number of ticks.
 //
+//	An "on demand" timer only interrupts while it has been started, so
+//	that the kernel can turn it off when there is nothing to time-slice
+//	between (which also lets an idle machine skip straight to the next
+//	real event).
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -22,15 +27,23 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "interrupt.h"
 
 // The following class defines a hardware timer. 
 class Timer {
   public:
-    Timer(VoidFunctionPtr timerHandler, _int callArg, bool doRandom);
+    Timer(VoidFunctionPtr timerHandler, _int callArg, bool doRandom,
+	bool startStopped = FALSE);
 				// Initialize the timer, to call the interrupt
-				// handler "timerHandler" every time slice.
+				// handler "timerHandler" every time slice
+				// (once started, if "startStopped").
     ~Timer() {}
 
+    void Start();		// Interrupt every time slice from now on
+    void Stop();		// Stop interrupting, until Start
+    bool isOnDemand() { return onDemand; } // started and stopped
+				// by the kernel, as needed?
+
 // Internal routines to the timer emulation -- DO NOT call these
 
     void TimerExpired();	// called internally when the hardware
@@ -43,7 +56,8 @@ class Timer {
     bool randomize;		// set if we need to use a random timeout delay
     VoidFunctionPtr handler;	// timer interrupt handler 
     _int arg;			// argument to pass to interrupt handler
-
+    bool onDemand;		// did it start out stopped?
+    IntHandle next;		// its next interrupt, unset if stopped
 };
 
 #endif // TIMER_H
@@ -0,0 +1,126 @@
+// tracewriter.cc
+//	Routines to record a compressed trace of a user program's
+//	execution.  See tracewriter.h, and bin/trace.h for the format.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "tracewriter.h"
+
+//----------------------------------------------------------------------
+// TraceWriter::TraceWriter
+// 	Create the trace file, and write its header.
+//
+//	"fileName" -- the UNIX file to write the trace to
+//	"pageSize" -- the machine's page size, for the analysis tools
+//----------------------------------------------------------------------
+
+TraceWriter::TraceWriter(char *fileName, int pageSize)
+{
+    TraceHeader header;
+
+    file = OpenForWrite(fileName);
+    buffer = new char[TraceBufferSize];
+    used = 0;
+    nextPC = 0;
+    run = 0;
+    lastAddr = 0;
+
+    header.traceMagic = TRACEMAGIC;
+    header.pageSize = pageSize;
+    WriteFile(file, (char *) &header, sizeof(header));
+}
+
+//----------------------------------------------------------------------
+// TraceWriter::~TraceWriter
+// 	Write out anything still buffered, and close the trace file.
+//----------------------------------------------------------------------
+
+TraceWriter::~TraceWriter()
+{
+    EndRun();
+    Flush();
+    Close(file);
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// TraceWriter::Access
+// 	Record a load or store of "size" (1, 2 or 4) bytes at virtual
+//	address "addr".
+//----------------------------------------------------------------------
+
+void
+TraceWriter::Access(int addr, int size, bool writing)
+{
+    EndRun();
+    Put(TraceAccess | (writing ? TraceWrite : 0) | (size == 4 ? 2 : size - 1));
+    PutSigned(addr - lastAddr);
+    lastAddr = addr;
+}
+
+//----------------------------------------------------------------------
+// TraceWriter::Exception
+// 	Record a trap to the kernel, of ExceptionType "which";
+//	"badVAddr" is the address that caused it, if any.
+//----------------------------------------------------------------------
+
+void
+TraceWriter::Exception(int which, int badVAddr)
+{
+    EndRun();
+    Put(TraceException | which);
+    PutNumber((unsigned int) badVAddr);
+}
+
+//----------------------------------------------------------------------
+// TraceWriter::PutNumber, TraceWriter::PutSigned
+// 	Append a number to the trace, 7 bits per byte, low bits first.
+//	Signed numbers are folded first, so that small negative numbers
+//	take few bytes too.
+//----------------------------------------------------------------------
+
+void
+TraceWriter::PutNumber(unsigned int n)
+{
+    while (n >= 0x80) {
+	Put((n & 0x7f) | 0x80);
+	n >>= 7;
+    }
+    Put(n);
+}
+
+void
+TraceWriter::PutSigned(int n)
+{
+    PutNumber(((unsigned int) n << 1) ^ (unsigned int) (n >> 31));
+}
+
+//----------------------------------------------------------------------
+// TraceWriter::EndRun
+// 	Record the run of consecutive instructions counted so far, if
+//	any, before something else is recorded.
+//----------------------------------------------------------------------
+
+void
+TraceWriter::EndRun()
+{
+    if (run > 0)
+	Put(run);
+    run = 0;
+}
+
+//----------------------------------------------------------------------
+// TraceWriter::Flush
+// 	Write the buffered records to the trace file.
+//----------------------------------------------------------------------
+
+void
+TraceWriter::Flush()
+{
+    if (used > 0)
+	WriteFile(file, buffer, used);
+    used = 0;
+}
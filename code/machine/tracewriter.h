@@ -0,0 +1,90 @@
+// tracewriter.h
+//	Data structures for recording a trace of a user program's
+//	execution, to be analyzed later (by bin/tracestat) rather than
+//	printed as it happens (as with -d m).
+//
+//	The machine simulation records each instruction executed, each
+//	load and store, and each trap to the kernel.  The trace is
+//	compressed as described in bin/trace.h, and written to the UNIX
+//	file in large blocks.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "trace.h"
+
+#define TraceBufferSize 65536	// bytes written to the file at a time
+
+// The following class defines a trace being written to a UNIX file.
+
+class TraceWriter {
+  public:
+    TraceWriter(char *fileName, int pageSize);	// Create the trace file
+    ~TraceWriter();			// Write out the rest, and close it
+
+    void Instruction(int pc);		// an instruction was executed at "pc"
+    void Access(int addr, int size, bool writing);
+					// a load or store of "size" bytes
+					// at "addr"
+    void Exception(int which, int badVAddr);
+					// a trap to the kernel, of
+					// ExceptionType "which"
+
+  private:
+    void Put(int byte);			// append a byte to the trace
+    void PutNumber(unsigned int n);	// and a number, 7 bits per byte
+    void PutSigned(int n);		// and a signed number
+    void EndRun();			// record the run so far, if any
+    void Flush();			// write out the buffer
+
+    int file;				// the UNIX file descriptor
+    char *buffer;			// records not yet written
+    int used;				// # of bytes in buffer
+    int nextPC;				// where the next instruction would
+					// be, if no jump
+    int run;				// # of instructions in the current run
+    int lastAddr;			// address of the last load or store
+};
+
+//----------------------------------------------------------------------
+// TraceWriter::Put
+// 	Append one byte to the trace, writing out the buffer if it's full.
+//----------------------------------------------------------------------
+
+inline void
+TraceWriter::Put(int byte)
+{
+    if (used == TraceBufferSize)
+	Flush();
+    buffer[used++] = (char) byte;
+}
+
+//----------------------------------------------------------------------
+// TraceWriter::Instruction
+// 	Record that an instruction was executed at "pc".  This is done for
+//	every instruction, so it is usually just a count.
+//----------------------------------------------------------------------
+
+inline void
+TraceWriter::Instruction(int pc)
+{
+    if (pc == nextPC && run < TraceRunMax)
+	run++;
+    else if (pc == nextPC) {	// the run is as long as a record can hold
+	EndRun();
+	run = 1;
+    } else {
+	EndRun();
+	Put(TraceJump);
+	PutSigned((pc - nextPC) / 4);
+    }
+    nextPC = pc + 4;
+}
+
+#endif // TRACEWRITER_H
@@ -33,9 +33,18 @@
 #include "machine.h"
 #include "addrspace.h"
 #include "system.h"
+#include "tracewriter.h"
 
 extern Machine *machine; 
 
+// DEBUG, but compiled away unless Config includes TraceConfig (see
+// machine.h).  Only for use inside the Config templates below.
+#define TRACE                    \
+	if (!(Config & TraceConfig)) \
+		;                        \
+	else                         \
+		DEBUG
+
 // Routines for converting Words and Short Words to and from the
 // simulated machine's format of little endian.  These end up
 // being NOPs when the host machine is also little endian (DEC and Intel).
@@ -86,34 +95,49 @@ ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
 //	"size" -- the number of bytes to read (1, 2, or 4)
 //	"value" -- the place to write the result
 //----------------------------------------------------------------------
+template <int Config>
 bool Machine::ReadMem(int addr, int size, int *value)
 {
 	int data;
 	ExceptionType exception;
 	int physicalAddress;
+	HostTLBEntry *h = &hostTLB[((unsigned)addr >> pageShift) & (HostTLBSize - 1)];
+	char *host;
 
-	DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
-
-	exception = Translate(addr, &physicalAddress, size, FALSE);
-	if (exception != NoException)
+	if ((Config & TraceConfig) && trace != NULL)
+		trace->Access(addr, size, FALSE);
+	if (((unsigned)addr & (~(pageSize - 1) | (size - 1))) == h->readTag)
+	{ // cached translation
+		host = h->hostPage + ((unsigned)addr & (pageSize - 1));
+		if (Config & TLBConfig)
+			counts->numTLBHits++; // (it was in the TLB)
+	}
+	else
 	{
-		machine->RaiseException(exception, addr);
-		return FALSE;
+		TRACE('a', "Reading VA 0x%x, size %d\n", addr, size);
+
+		exception = Translate<Config>(addr, &physicalAddress, size, FALSE);
+		if (exception != NoException)
+		{
+			RaiseException(exception, addr);
+			return FALSE;
+		}
+		host = &mainMemory[physicalAddress];
 	}
 	switch (size)
 	{
 	case 1:
-		data = machine->mainMemory[physicalAddress];
+		data = *(unsigned char *)host;
 		*value = data;
 		break;
 
 	case 2:
-		data = *(unsigned short *)&machine->mainMemory[physicalAddress];
+		data = *(unsigned short *)host;
 		*value = ShortToHost(data);
 		break;
 
 	case 4:
-		data = *(unsigned int *)&machine->mainMemory[physicalAddress];
+		data = *(unsigned int *)host;
 		*value = WordToHost(data);
 		break;
 
@@ -121,7 +145,7 @@ bool Machine::ReadMem(int addr, int size, int *value)
 		ASSERT(FALSE);
 	}
 
-	DEBUG('a', "\tvalue read = %8.8x\n", *value);
+	TRACE('a', "\tvalue read = %8.8x\n", *value);
 	return (TRUE);
 }
 
@@ -138,31 +162,50 @@ bool Machine::ReadMem(int addr, int size, int *value)
 //	"value" -- the data to be written
 //----------------------------------------------------------------------
 
+template <int Config>
 bool Machine::WriteMem(int addr, int size, int value)
 {
 	ExceptionType exception;
 	int physicalAddress;
+	HostTLBEntry *h = &hostTLB[((unsigned)addr >> pageShift) & (HostTLBSize - 1)];
+	char *host;
 
-	DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
+	if ((Config & TraceConfig) && trace != NULL)
+		trace->Access(addr, size, TRUE);
 
-	exception = Translate(addr, &physicalAddress, size, TRUE);
-	if (exception != NoException)
+	// a write hit means the page is dirty and has no decoded instructions
+	if (((unsigned)addr & (~(pageSize - 1) | (size - 1))) == h->writeTag)
+	{
+		host = h->hostPage + ((unsigned)addr & (pageSize - 1));
+		if (Config & TLBConfig)
+			counts->numTLBHits++;
+	}
+	else
 	{
-		machine->RaiseException(exception, addr);
-		return FALSE;
+		TRACE('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
+
+		exception = Translate<Config>(addr, &physicalAddress, size, TRUE);
+		if (exception != NoException)
+		{
+			RaiseException(exception, addr);
+			return FALSE;
+		}
+		if (decodePageValid[physicalAddress >> pageShift]) // self-modifying code?
+			InvalidateDecodedPage(physicalAddress >> pageShift);
+		host = &mainMemory[physicalAddress];
 	}
 	switch (size)
 	{
 	case 1:
-		machine->mainMemory[physicalAddress] = (unsigned char)(value & 0xff);
+		*(unsigned char *)host = (unsigned char)(value & 0xff);
 		break;
 
 	case 2:
-		*(unsigned short *)&machine->mainMemory[physicalAddress] = ShortToMachine((unsigned short)(value & 0xffff));
+		*(unsigned short *)host = ShortToMachine((unsigned short)(value & 0xffff));
 		break;
 
 	case 4:
-		*(unsigned int *)&machine->mainMemory[physicalAddress] = WordToMachine((unsigned int)value);
+		*(unsigned int *)host = WordToMachine((unsigned int)value);
 		break;
 
 	default:
@@ -187,6 +230,7 @@ bool Machine::WriteMem(int addr, int size, int value)
 // 	"writing" -- if TRUE, check the "read-only" bit in the TLB
 //----------------------------------------------------------------------
 
+template <int Config>
 ExceptionType
 Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 {
@@ -195,76 +239,364 @@ Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 	TranslationEntry *entry;
 	unsigned int pageFrame;
 
-	DEBUG('a', "\tTranslate 0x%x, %s: ", virtAddr, writing ? "write" : "read");
+	TRACE('a', "\tTranslate 0x%x, %s: ", virtAddr, writing ? "write" : "read");
 
 	// check for alignment errors
 	if (((size == 4) && (virtAddr & 0x3)) || ((size == 2) && (virtAddr & 0x1)))
 	{
-		DEBUG('a', "alignment problem at %d, size %d!\n", virtAddr, size);
+		TRACE('a', "alignment problem at %d, size %d!\n", virtAddr, size);
 		return AddressErrorException;
 	}
 
 	// we must have either a TLB or a page table, but not both!
-	ASSERT(tlb == NULL || pageTable == NULL);
-	ASSERT(tlb != NULL || pageTable != NULL);
+	ASSERT(tlb == NULL || (pageTable == NULL && pageDirectory == NULL));
 
 	// calculate the virtual page number, and offset within the page,
 	// from the virtual address
-	vpn = (unsigned)virtAddr / PageSize;
-	offset = (unsigned)virtAddr % PageSize;
+	vpn = (unsigned)virtAddr >> pageShift;
+	offset = (unsigned)virtAddr & (pageSize - 1);
 
-	if (tlb == NULL)
+	if (!(Config & TLBConfig) && tableKind == LinearTable)
 	{ // => page table => vpn is index into table
+		ASSERT(pageTable != NULL);
 		if (vpn >= pageTableSize)
 		{
-			DEBUG('a', "virtual page # %d too large for page table size %d!\n",
+			TRACE('a', "virtual page # %d too large for page table size %d!\n",
 				  virtAddr, pageTableSize);
 			return AddressErrorException;
 		}
 		else if (!pageTable[vpn].valid)
 		{
-			DEBUG('a', "virtual page # %d too large for page table size %d!\n",
+			TRACE('a', "virtual page # %d too large for page table size %d!\n",
 				  virtAddr, pageTableSize);
 			return PageFaultException;
 		}
 		entry = &pageTable[vpn];
 	}
+	else if (!(Config & TLBConfig))
+	{ // walk the two-level or inverted table
+		if (tableKind == TwoLevelTable)
+		{
+			ASSERT(pageDirectory != NULL);
+			if (vpn >= pageDirectory->getNumPages())
+			{
+				TRACE('a', "virtual page # %d too large for page table size %d!\n",
+					  virtAddr, pageDirectory->getNumPages());
+				return AddressErrorException;
+			}
+			entry = pageDirectory->Lookup(vpn);
+		}
+		else
+			entry = invertedTable->Lookup(currentASID, vpn);
+		if (entry == NULL || !entry->valid)
+		{
+			TRACE('a', "virtual page # %d not mapped!\n", vpn);
+			return PageFaultException;
+		}
+	}
 	else
 	{
-		for (entry = NULL, i = 0; i < TLBSize; i++)
-			if (tlb[i].valid && ((unsigned int)tlb[i].virtualPage == vpn))
+		// only the set the page maps to can hold it
+		int first = (vpn & (tlbSets - 1)) * tlbSetWays;
+
+		for (entry = NULL, i = first; i < first + tlbSetWays; i++)
+			if (tlb[i].valid && ((unsigned int)tlb[i].virtualPage == vpn) &&
+				tlbASID[i] == currentASID)
 			{
 				entry = &tlb[i]; // FOUND!
 				break;
 			}
 		if (entry == NULL)
 		{ // not found
-			DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+			counts->numTLBMisses++;
+			TRACE('a', "*** no valid TLB entry found for this virtual page!\n");
 			return PageFaultException; // really, this is a TLB fault,
 									   // the page may be in memory,
 									   // but not in the TLB
 		}
+		counts->numTLBHits++;
+		if (tlbPolicy != TLBRandom)
+			TouchTLB(i);
 	}
 
 	if (entry->readOnly && writing)
 	{ // trying to write to a read-only page
-		DEBUG('a', "%d mapped read-only at %d in TLB!\n", virtAddr, i);
+		TRACE('a', "%d mapped read-only at %d in TLB!\n", virtAddr, i);
 		return ReadOnlyException;
 	}
 	pageFrame = entry->physicalPage;
 
 	// if the pageFrame is too big, there is something really wrong!
 	// An invalid translation was loaded into the page table or TLB.
-	if (pageFrame >= NumPhysPages)
+	if (pageFrame >= (unsigned)numPhysPages)
 	{
-		DEBUG('a', "*** frame %d > %d!\n", pageFrame, NumPhysPages);
+		TRACE('a', "*** frame %d > %d!\n", pageFrame, numPhysPages);
 		return BusErrorException;
 	}
 	entry->use = TRUE; // set the use, dirty bits
 	if (writing)
 		entry->dirty = TRUE;
-	*physAddr = pageFrame * PageSize + offset;
+	*physAddr = (pageFrame << pageShift) + offset;
 	ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
-	DEBUG('a', "phys addr = 0x%x\n", *physAddr);
+	TRACE('a', "phys addr = 0x%x\n", *physAddr);
+
+	// Remember the translation, so that the next access to this page
+	// can skip all of the above.  Writes may only use it once the dirty
+	// bit is set, and only while the page holds no decoded instructions
+	// (so that WriteMem need not check).
+	if (hostTLBEnabled)
+	{
+		HostTLBEntry *h = &hostTLB[vpn & (HostTLBSize - 1)];
+
+		h->readTag = vpn << pageShift;
+		if (entry->dirty && !entry->readOnly && !decodePageValid[pageFrame])
+			h->writeTag = vpn << pageShift;
+		else
+			h->writeTag = HostTLBNone;
+		h->hostPage = &mainMemory[pageFrame << pageShift];
+		h->physPage = pageFrame;
+	}
 	return NoException;
 }
+
+//----------------------------------------------------------------------
+// Machine::FlushHostTLB
+// 	Forget every translation cached by Translate.  Must be called
+//	whenever the page table or TLB changes underneath us: on a context
+//	switch, or when the kernel edits an entry (including clearing the
+//	use or dirty bits, which cached translations no longer update).
+//----------------------------------------------------------------------
+
+void Machine::FlushHostTLB()
+{
+	for (int i = 0; i < HostTLBSize; i++)
+	{
+		hostTLB[i].readTag = HostTLBNone;
+		hostTLB[i].writeTag = HostTLBNone;
+		hostTLB[i].hostPage = NULL;
+		hostTLB[i].physPage = -1;
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::RevokeHostTLBWrite
+// 	Make writes to a physical page go the slow way through WriteMem,
+//	because instructions on it have just been decoded, and writing
+//	it must now invalidate them.
+//
+//	"physPage" -- the physical page that now holds decoded code
+//----------------------------------------------------------------------
+
+void Machine::RevokeHostTLBWrite(int physPage)
+{
+	for (int i = 0; i < HostTLBSize; i++)
+		if (hostTLB[i].physPage == physPage)
+			hostTLB[i].writeTag = HostTLBNone;
+}
+
+//----------------------------------------------------------------------
+// Machine::TouchTLB
+// 	Note that TLB entry "index" has just been used, for the replacement
+//	policy.  LRU stamps the entry with the time of use; pseudo-LRU
+//	keeps a binary tree over the ways of each set, whose bits point
+//	away from the half that was used most recently.
+//----------------------------------------------------------------------
+
+void Machine::TouchTLB(int index)
+{
+	int set = index / tlbSetWays, way = index % tlbSetWays;
+
+	if (tlbPolicy == TLBLRU)
+		tlbStamp[index] = ++tlbClock;
+	else if (tlbPolicy == TLBPseudoLRU)
+	{
+		// node 1 is the root; the leaves tlbSetWays .. 2*tlbSetWays-1
+		// are the ways, and node n's children are 2n and 2n+1
+		for (int node = way + tlbSetWays; node > 1; node >>= 1)
+		{
+			int parent = node >> 1;
+
+			if (node & 1) // used the right half, point left
+				tlbTree[set] &= ~(1u << parent);
+			else
+				tlbTree[set] |= 1u << parent;
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBVictim
+// 	Return the TLB entry of "set" to replace: an invalid one if there
+//	is one, otherwise the one tlbPolicy picks.
+//----------------------------------------------------------------------
+
+int Machine::TLBVictim(int set)
+{
+	int first = set * tlbSetWays, victim = first, i;
+
+	for (i = first; i < first + tlbSetWays; i++)
+		if (!tlb[i].valid)
+			return i;
+
+	switch (tlbPolicy)
+	{
+	case TLBLRU:
+		for (i = first + 1; i < first + tlbSetWays; i++)
+			if (tlbClock - tlbStamp[i] > tlbClock - tlbStamp[victim])
+				victim = i; // used longer ago (allowing for wraparound)
+		return victim;
+	case TLBPseudoLRU:
+	{
+		int node = 1;
+
+		while (node < tlbSetWays)
+			node = 2 * node + ((tlbTree[set] >> node) & 1);
+		return first + node - tlbSetWays;
+	}
+	default:
+		return first + Random() % tlbSetWays;
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::LoadTLB
+// 	Load a translation into the TLB, as the kernel does on a TLB miss
+//	(PageFaultException).  The entry goes into the set its virtual
+//	page maps to, replacing any older entry for the same page, or else
+//	the victim chosen by tlbPolicy.  It belongs to the current ASID.
+//
+//	"entry" -- the translation to load, normally from a page table
+//----------------------------------------------------------------------
+
+void Machine::LoadTLB(TranslationEntry *entry)
+{
+	int set = entry->virtualPage & (tlbSets - 1);
+	int first = set * tlbSetWays, i;
+
+	ASSERT(tlb != NULL);
+	for (i = first; i < first + tlbSetWays; i++)
+		if (tlb[i].valid && tlb[i].virtualPage == entry->virtualPage &&
+			tlbASID[i] == currentASID)
+			break;
+	if (i == first + tlbSetWays)
+		i = TLBVictim(set);
+
+	// the translation being replaced may be cached by Translate
+	if (tlb[i].valid)
+	{
+		HostTLBEntry *h =
+			&hostTLB[tlb[i].virtualPage & (HostTLBSize - 1)];
+
+		if (h->readTag == (unsigned)tlb[i].virtualPage << pageShift)
+		{
+			h->readTag = HostTLBNone;
+			h->writeTag = HostTLBNone;
+		}
+	}
+	DEBUG('a', "Loading page %d into TLB entry %d\n", entry->virtualPage, i);
+	tlb[i] = *entry;
+	tlbASID[i] = currentASID;
+	TouchTLB(i);
+}
+
+//----------------------------------------------------------------------
+// Machine::SetASID
+// 	Switch the TLB, or the inverted page table, to address space
+//	"asid", on a context switch.  With tlbASIDs, the TLB entries of
+//	other address spaces simply stop matching; without, the TLB is
+//	emptied, as on the real MIPS -- unless we are switching back to
+//	the space whose entries it already holds.
+//----------------------------------------------------------------------
+
+void Machine::SetASID(int asid)
+{
+	if (asid != currentASID)
+	{
+		if (tlb != NULL && !tlbASIDs)
+			FlushTLB(currentASID);
+		currentASID = asid;
+	}
+	FlushHostTLB();
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTLB
+// 	Invalidate the TLB entries of address space "asid", for instance
+//	because it is going away.  (Without tlbASIDs, the TLB only ever
+//	holds entries of the current address space.)
+//----------------------------------------------------------------------
+
+void Machine::FlushTLB(int asid)
+{
+	for (int i = 0; i < tlbSize; i++)
+		if (tlbASID[i] == asid)
+			tlb[i].valid = FALSE;
+	FlushHostTLB();
+}
+
+//----------------------------------------------------------------------
+// Machine::ReadMem, Machine::WriteMem, Machine::Translate
+// 	The versions for the rest of Nachos, which don't know the Config:
+//	call the one for the features this run needs (single stepping
+//	doesn't matter here).
+//----------------------------------------------------------------------
+
+bool Machine::ReadMem(int addr, int size, int *value)
+{
+	switch (config & (TraceConfig | TLBConfig))
+	{
+	case 0:
+		return ReadMem<0>(addr, size, value);
+	case TraceConfig:
+		return ReadMem<TraceConfig>(addr, size, value);
+	case TLBConfig:
+		return ReadMem<TLBConfig>(addr, size, value);
+	default:
+		return ReadMem<TraceConfig | TLBConfig>(addr, size, value);
+	}
+}
+
+bool Machine::WriteMem(int addr, int size, int value)
+{
+	switch (config & (TraceConfig | TLBConfig))
+	{
+	case 0:
+		return WriteMem<0>(addr, size, value);
+	case TraceConfig:
+		return WriteMem<TraceConfig>(addr, size, value);
+	case TLBConfig:
+		return WriteMem<TLBConfig>(addr, size, value);
+	default:
+		return WriteMem<TraceConfig | TLBConfig>(addr, size, value);
+	}
+}
+
+ExceptionType
+Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
+{
+	switch (config & (TraceConfig | TLBConfig))
+	{
+	case 0:
+		return Translate<0>(virtAddr, physAddr, size, writing);
+	case TraceConfig:
+		return Translate<TraceConfig>(virtAddr, physAddr, size, writing);
+	case TLBConfig:
+		return Translate<TLBConfig>(virtAddr, physAddr, size, writing);
+	default:
+		return Translate<TraceConfig | TLBConfig>(virtAddr, physAddr, size, writing);
+	}
+}
+
+// The simulation code in mipssim.cc needs these too.
+template ExceptionType Machine::Translate<0>(int, int *, int, bool);
+template ExceptionType Machine::Translate<TLBConfig>(int, int *, int, bool);
+template ExceptionType Machine::Translate<TraceConfig>(int, int *, int, bool);
+template ExceptionType Machine::Translate<TraceConfig | TLBConfig>(int, int *, int, bool);
+template bool Machine::ReadMem<0>(int, int, int *);
+template bool Machine::ReadMem<TLBConfig>(int, int, int *);
+template bool Machine::ReadMem<TraceConfig>(int, int, int *);
+template bool Machine::ReadMem<TraceConfig | TLBConfig>(int, int, int *);
+template bool Machine::WriteMem<0>(int, int, int);
+template bool Machine::WriteMem<TLBConfig>(int, int, int);
+template bool Machine::WriteMem<TraceConfig>(int, int, int);
+template bool Machine::WriteMem<TraceConfig | TLBConfig>(int, int, int);
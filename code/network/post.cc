@@ -18,6 +18,7 @@
 
 #include "copyright.h"
 #include "post.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // Mail::Mail
@@ -92,13 +93,17 @@ PrintHeader(PacketHeader pktHdr, MailHeader mailHdr)
 //	"pktHdr" -- source, destination machine ID's
 //	"mailHdr" -- source, destination mailbox ID's
 //	"data" -- payload message data
+//	"arrived" -- when the message came off the network
 //----------------------------------------------------------------------
 
 void 
-MailBox::Put(PacketHeader pktHdr, MailHeader mailHdr, char *data)
+MailBox::Put(PacketHeader pktHdr, MailHeader mailHdr, char *data,
+	     int arrived)
 { 
     Mail *mail = new Mail(pktHdr, mailHdr, data); 
 
+    mail->arrived = arrived;
+
     messages->Append((void *)mail);	// put on the end of the list of 
 					// arrived messages, and wake up 
 					// any waiters
@@ -132,6 +137,7 @@ MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data)
     bcopy(mail->data, data, mail->mailHdr.length);
 					// copy the message data into
 					// the caller's buffer
+    stats->mailLatency.EnterLog(stats->totalTicks - mail->arrived);
     delete mail;			// we've copied out the stuff we
 					// need, we can now discard the message
 }
@@ -181,6 +187,7 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability,
     messageAvailable = new Semaphore("message available", 0);
     messageSent = new Semaphore("message sent", 0);
     sendLock = new Lock("message send lock");
+    arrivalTime = 0;
 
 // Second, initialize the mailboxes
     netAddr = addr; 
@@ -193,9 +200,11 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability,
 
 
 // Finally, create a thread whose sole job is to wait for incoming messages,
-//   and put them in the right mailbox. 
+//   and put them in the right mailbox.  It should get to them before
+//   threads that are just computing, if the scheduler has priorities.
     Thread *t = new Thread("postal worker");
 
+    t->setPriority(IOPriority);
     t->Fork(PostalHelper, (_int) this);
 }
 
@@ -227,10 +236,12 @@ PostOffice::PostalDelivery()
     PacketHeader pktHdr;
     MailHeader mailHdr;
     char *buffer = new char[MaxPacketSize];
+    int arrived;
 
     for (;;) {
         // first, wait for a message
         messageAvailable->P();	
+        arrived = arrivalTime;	// (before another packet can arrive)
         pktHdr = network->Receive(buffer);
 
         mailHdr = *(MailHeader *)buffer;
@@ -244,7 +255,8 @@ PostOffice::PostalDelivery()
 	ASSERT(mailHdr.length <= MaxMailSize);
 
 	// put into mailbox
-        boxes[mailHdr.to].Put(pktHdr, mailHdr, buffer + sizeof(MailHeader));
+        boxes[mailHdr.to].Put(pktHdr, mailHdr, buffer + sizeof(MailHeader),
+			      arrived);
     }
 }
 
@@ -327,11 +339,14 @@ PostOffice::Receive(int box, PacketHeader *pktHdr,
 // 	Interrupt handler, called when a packet arrives from the network.
 //
 //	Signal the PostalDelivery routine that it is time to get to work!
+//	The time is noted, to measure how long the message takes to get
+//	to whoever receives it.
 //----------------------------------------------------------------------
 
 void
 PostOffice::IncomingPacket()
 { 
+    arrivalTime = stats->totalTicks;
     messageAvailable->V(); 
 }
 
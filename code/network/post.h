@@ -68,6 +68,7 @@ class Mail {
      PacketHeader pktHdr;	// Header appended by Network
      MailHeader mailHdr;	// Header appended by PostOffice
      char data[MaxMailSize];	// Payload -- message data
+     int arrived;		// When it came off the network
 };
 
 // The following class defines a single mailbox, or temporary storage
@@ -80,8 +81,9 @@ class MailBox {
     MailBox();			// Allocate and initialize mail box
     ~MailBox();			// De-allocate mail box
 
-    void Put(PacketHeader pktHdr, MailHeader mailHdr, char *data);
-   				// Atomically put a message into the mailbox
+    void Put(PacketHeader pktHdr, MailHeader mailHdr, char *data,
+	     int arrived);	// Atomically put a message into the mailbox,
+				// noting when it came off the network
     void Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data); 
    				// Atomically get a message out of the 
 				// mailbox (and wait if there is no message 
@@ -137,6 +139,7 @@ class PostOffice {
     Semaphore *messageAvailable;// V'ed when message has arrived from network
     Semaphore *messageSent;	// V'ed when next message can be sent to network
     Lock *sendLock;		// Only one outgoing message at a time
+    int arrivalTime;		// When the incoming packet arrived
 };
 
 #endif
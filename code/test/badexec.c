@@ -0,0 +1,19 @@
+/* badexec.c
+ *	Test that a system call given a bad pointer fails, rather than
+ *	crashing the kernel: Exec is passed a file name at an address
+ *	that isn't mapped, and must return -1.
+ *
+ *	Exits with 0 if it did, and 1 if not.
+ */
+
+#include "syscall.h"
+
+int main()
+{
+    SpaceId pid;
+
+    pid = Exec((char *)0x7fff0000); /* far beyond the program's pages */
+    if (pid == -1)
+        Exit(0);
+    Exit(1);
+}
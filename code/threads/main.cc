@@ -8,8 +8,19 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
+// Usage: nachos -d <debugflags> -rs <random seed #> -tickless
+//		-sched <fifo|priority|mlfq|fair>
+//		-stats <unix file> -timeline <unix file>
+//		-mlfqtest -stacktest
+//		-s -x <nachos file> -xrt <nachos file>
+//		-cpus <# CPUs> -xp <nachos file> <# copies>
+//		-c <consoleIn> <consoleOut>
+//		-engine <interp|threaded|block> -profile -trace <unix file>
+//		-checkpoint <unix file> <ticks> -restore <unix file>
+//		-mem <# pages> -pagesize <bytes> -memfile <unix file>
+//		-tlbsize <# entries>
+//		-tlbways <# entries> -tlbpolicy <random|lru|plru> -tlbasid
+//		-pagetable <linear|twolevel|inverted>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -e <network orderability>
@@ -19,12 +30,63 @@
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -tickless only runs the -rs timer while another thread is ready
+//	to run, so a lone thread, or an idle machine, isn't interrupted
+//    -sched picks which ready thread runs next: the one ready longest
+//	("fifo", the default), the one of highest priority (see
+//	Thread::setPriority), which kernel threads doing I/O get, or
+//	with "mlfq", the one that has used the least CPU time lately, or
+//	with "fair", the one that has had the least CPU time for its share
+//	(see threads/scheduler.cc); these two start the timer, if -rs
+//	doesn't
+//    -stats writes all the statistics to a UNIX file at halt, as
+//	"name value" lines (see Statistics::Dump)
+//    -timeline records context switches, interrupts, disk requests,
+//	system calls and lock waits in a UNIX file, to be viewed with
+//	chrome://tracing or Perfetto (see threads/timeline.h)
 //    -z prints the copyright message
 //
+//  THREADS
+//    -mlfqtest checks that the MLFQ takes turns among CPU-bound threads
+//	at its bottom level (run it with -sched mlfq)
+//    -stacktest checks that the stacks of finished threads are pooled,
+//	and used again (see threads/thread.cc)
+//
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
 //    -x runs a user program
+//    -xrt runs a user program alongside a real-time kernel thread, to
+//	test -checkpoint and -restore with a scheduler interrupt pending
+//    -cpus runs user programs on that many simulated CPUs at once, each
+//	simulated by a host thread of its own (see userprog/smp.h); only
+//	with the FIFO scheduler, and not with -s, -trace, -checkpoint or
+//	the inverted page table
+//    -xp runs that many copies of a user program at once, to test -cpus
 //    -c tests the console
+//    -engine selects how user instructions are executed: "interp" (the
+//	default), "threaded" or "block" (faster; see Machine::RunThreaded)
+//    -profile counts how often each user instruction is executed, and
+//	prints the hot spots of each program at halt (see userprog/profile.h)
+//    -trace records every user instruction, load, store and trap in a
+//	UNIX file, for bin/tracestat to analyze (see machine/tracewriter.h)
+//    -mem, -pagesize and -tlbsize set the size of physical memory (in
+//	pages; default 64), of a page (a power of two; default 128 bytes)
+//	and of the TLB, if there is one (default 4 entries).  Host memory
+//	is only used for the pages that get touched.
+//    -memfile keeps physical memory in a UNIX file, which it starts out
+//	with, and which holds its contents when Nachos exits
+//    -tlbways divides the TLB into sets of that many entries (default:
+//	one set); -tlbpolicy picks the entry of a set a TLB miss replaces
+//	(default random); -tlbasid tags entries with their address space,
+//	so that a context switch needn't empty the TLB
+//    -pagetable picks the kind of page table user programs get: linear
+//	(the default), two-level, or the machine-wide inverted page table
+//    -checkpoint saves the running user program to a UNIX file, once
+//	the simulated time reaches <ticks> (see userprog/checkpoint.cc)
+//    -restore runs a user program saved by -checkpoint, from where it
+//	was saved.  Give the same devices (e.g., -rs) as the saved run;
+//	the restored program isn't profiled, and can't itself be
+//	checkpointed.
 //
 //  FILESYS
 //    -f causes the physical disk to be formatted
@@ -54,13 +116,16 @@
 
 #include "utility.h"
 #include "system.h"
+#include <stdlib.h>
 // External functions used by this file
 
 extern void ThreadTest(void), Copy(char *unixFile, char *nachosFile);
 extern void Print(char *file), PerformanceTest(void);
 extern void StartProcess(char *file), ConsoleTest(char *in, char *out);
+extern void RestoreProcess(char *file), PeriodicTest(char *file);
+extern void ParallelTest(char *file, int copies);
 extern void MailTest(int networkID);
-extern void SynchTest(void);
+extern void SynchTest(void), MLFQTest(void), StackPoolTest(void);
 
 //----------------------------------------------------------------------
 // main
@@ -97,6 +162,12 @@ int main(int argc, char **argv)
 		argCount = 1;
 		if (!strcmp(*argv, "-z")) // print copyright
 			printf("\n\n%s\n\n", copyright);
+#ifdef THREADS
+		if (!strcmp(*argv, "-mlfqtest")) // test the MLFQ's time slices
+			MLFQTest();
+		if (!strcmp(*argv, "-stacktest")) // test the stack pool
+			StackPoolTest();
+#endif // THREADS
 #ifdef USER_PROGRAM
 		if (!strcmp(*argv, "-x"))
 		{ // run a user program
@@ -104,6 +175,24 @@ int main(int argc, char **argv)
 			StartProcess(*(argv + 1));
 			argCount = 2;
 		}
+		else if (!strcmp(*argv, "-xrt"))
+		{ // run a user program next to a real-time thread
+			ASSERT(argc > 1);
+			PeriodicTest(*(argv + 1));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-xp"))
+		{ // run copies of a user program at once
+			ASSERT(argc > 2);
+			ParallelTest(*(argv + 1), atoi(*(argv + 2)));
+			argCount = 3;
+		}
+		else if (!strcmp(*argv, "-restore"))
+		{ // run a saved user program
+			ASSERT(argc > 1);
+			RestoreProcess(*(argv + 1));
+			argCount = 2;
+		}
 		else if (!strcmp(*argv, "-c"))
 		{ // test the console
 			if (argc == 1)
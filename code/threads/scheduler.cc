@@ -11,8 +11,61 @@
 //	end up calling FindNextToRun(), and that would put us in an
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	By default, a very simple implementation -- no priorities,
+//	straight FIFO.  With PriorityPolicy, each priority has its own
+//	FIFO queue, and the highest non-empty one is found from a bitmap,
+//	so that both making a thread ready and picking the next one take
+//	constant time.
+//
+//	MLFQPolicy uses the top MLFQLevels of the same queues, but sets
+//	each thread's level itself (ignoring Thread::setPriority):
+//	   - a new thread starts at the top;
+//	   - a thread that has had the CPU for the quantum of its level
+//	     (TimerTicks at the top, doubling at each level down), over
+//	     however many turns, is preempted and moves down a level;
+//	   - a thread that blocks (for I/O, say) moves up a level when it
+//	     is woken up, since it isn't hogging the CPU;
+//	   - every MLFQResetTicks, every thread goes back to the top, so
+//	     that CPU hogs aren't starved for good.
+//	The quanta are enforced by the timer, which the MLFQ needs (it is
+//	started even without -rs, to interrupt every TimerTicks).
+//
+//	FairSharePolicy shares the CPU in proportion to weights, as
+//	Linux's CFS does.  Each thread's CPU time is counted in its
+//	"virtual runtime", which runs faster the smaller its weight is,
+//	and the ready thread with the least runs next; the ready threads
+//	are kept in a binary heap, so that both take O(log n) time.  At
+//	each timer interrupt, the running thread is preempted if a ready
+//	thread has had less; so this, too, starts the timer.
+//	   - a new thread starts level with the least of the others, and
+//	     one woken up a little ahead of them (it can't save up the
+//	     time it spent blocked);
+//	   - address spaces made by Exec share their parent's weight (see
+//	     SchedGroup), so a process that starts many others gets no
+//	     more of the CPU, all told, than one that starts none.
+//
+//	Whatever the policy, real-time threads (see Thread::SetPeriodic)
+//	come first.  Each has a job to do every period, which is due by
+//	the end of the period; the ready one whose job is due first runs
+//	(earliest deadline first).  So that they can all meet their
+//	deadlines, a thread is only admitted if the CPU time the
+//	real-time threads would need, at most, is no more than all of it
+//	(the sum of budget/period).  Interrupts of the scheduler's own
+//	start each job (Release), and stop a job that has used up its
+//	budget (BudgetExpired) until its next period, so that an overrun
+//	can't make the others miss their deadlines.  A real-time thread
+//	woken by an interrupt handler preempts the running thread at
+//	once; one woken by another thread waits for the next timer
+//	interrupt, or for the running thread to give up the CPU.
+//
+//	With more than one CPU (-cpus, see userprog/smp.h), only FIFO is
+//	supported, and each CPU has a queue of its own.  A thread that
+//	has run user code is put on the queue of its CPU; any other goes
+//	to an idle CPU, if there is one, which is woken up, or else to
+//	the current CPU.  A CPU whose queue is empty takes a thread that
+//	can run anywhere from another's.  A CPU with nothing to run waits
+//	for another to give it a thread; only the last one to go idle
+//	waits for an interrupt, moving the clock on.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -22,14 +75,92 @@
 #include "scheduler.h"
 #include "system.h"
 
+//----------------------------------------------------------------------
+// ReleaseHandler, BudgetHandler
+// 	Interrupt handlers for the scheduler's own interrupts, which
+//	call Scheduler::Release and Scheduler::BudgetExpired.
+//----------------------------------------------------------------------
+
+static void
+ReleaseHandler(_int arg)
+{
+    scheduler->Release((Thread *)arg);
+}
+
+static void
+BudgetHandler(_int dummy)
+{
+    scheduler->BudgetExpired();
+}
+
+//----------------------------------------------------------------------
+// HighestBit
+// 	Return the number of the highest bit set in "mask" (which
+//	mustn't be 0), by binary search.
+//----------------------------------------------------------------------
+
+static int
+HighestBit(unsigned int mask)
+{
+    int bit = 0;
+
+    if (mask & 0xffff0000)
+    {
+        bit += 16;
+        mask >>= 16;
+    }
+    if (mask & 0xff00)
+    {
+        bit += 8;
+        mask >>= 8;
+    }
+    if (mask & 0xf0)
+    {
+        bit += 4;
+        mask >>= 4;
+    }
+    if (mask & 0xc)
+    {
+        bit += 2;
+        mask >>= 2;
+    }
+    if (mask & 0x2)
+        bit += 1;
+    return bit;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads to empty.
+//
+//	"whichPolicy" -- how to choose which ready thread runs next
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedPolicy whichPolicy)
 {
+    policy = whichPolicy;
+    numReady = 0;
     readyList = new List;
+    cpuQueue = new List *[numCPUs];
+    idleIn = new Thread *[numCPUs];
+    cpuQueue[0] = readyList;
+    for (int i = 0; i < numCPUs; i++)
+    {
+        if (i > 0)
+            cpuQueue[i] = new List;
+        idleIn[i] = NULL;
+    }
+    for (int i = 0; i < NumPriorities; i++)
+        queueHead[i] = queueTail[i] = NULL;
+    readyPriorities = 0;
+    sliceStart = 0;
+    epoch = 0;
+    nextReset = MLFQResetTicks;
+    maxFair = 16;
+    fairHeap = new Thread *[maxFair];
+    minVruntime = 0;
+    realTimeList = new List;
+    utilization = 0;
 #ifdef USER_PROGRAM
     waitingList = new List;
     terminatedList = new List;
@@ -43,7 +174,12 @@ Scheduler::Scheduler()
 
 Scheduler::~Scheduler()
 {
-    delete readyList;
+    for (int i = 0; i < numCPUs; i++)
+        delete cpuQueue[i]; // (readyList too)
+    delete[] cpuQueue;
+    delete[] idleIn;
+    delete[] fairHeap;
+    delete realTimeList;
 }
 
 //----------------------------------------------------------------------
@@ -58,8 +194,77 @@ void Scheduler::ReadyToRun(Thread *thread)
 {
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
+    if (thread->period > 0)
+    { // real-time: ahead of the rest, in order of deadline
+        thread->setStatus(READY);
+        thread->setReadyTime(stats->totalTicks);
+        realTimeList->SortedInsert((void *)thread, thread->deadline);
+        if (interrupt->isInHandler() && PreemptsCurrent(thread))
+            interrupt->YieldOnReturn();
+        if (timer != NULL && timer->isOnDemand())
+            timer->Start(); // so it can preempt a thread not real-time
+        return;
+    }
+    if (policy == MLFQPolicy)
+    {
+        Refresh(thread);
+        if (thread->getStatus() == RUNNING)
+            Charge(thread); // it's yielding
+        else if (thread->getStatus() == BLOCKED &&
+                 thread->level < NumPriorities - 1)
+        { // it's been waiting, not computing
+            thread->level++;
+            thread->usedTicks = 0;
+        }
+    }
+    else if (policy == FairSharePolicy)
+    {
+        if (thread->getStatus() == RUNNING)
+            Charge(thread); // it's yielding
+        else if (thread->getStatus() == BLOCKED)
+        { // don't let it make up for all the time it slept
+            if (thread->vruntime < minVruntime - TimerTicks)
+                thread->vruntime = minVruntime - TimerTicks;
+        }
+        else if (thread->vruntime < minVruntime)
+            thread->vruntime = minVruntime; // a new thread
+    }
     thread->setStatus(READY);
-    readyList->Append((void *)thread);
+    thread->setReadyTime(stats->totalTicks);
+    numReady++;
+    if (policy == FIFOPolicy && numCPUs > 1)
+    {
+        int cpu = CPUFor(thread);
+
+        cpuQueue[cpu]->Append((void *)thread);
+#ifdef USER_PROGRAM
+        if (cpu != currentCPU && idleIn[cpu] != NULL)
+            WakeCPU(cpu);
+#endif
+    }
+    else if (policy == FIFOPolicy)
+        readyList->Append((void *)thread);
+    else if (policy == FairSharePolicy)
+        FairPush(thread);
+    else
+    {
+        int p = QueueOf(thread);
+
+        thread->nextReady = NULL;
+        if (queueHead[p] == NULL)
+            queueHead[p] = thread;
+        else
+            queueTail[p]->nextReady = thread;
+        queueTail[p] = thread;
+        readyPriorities |= 1U << p;
+
+        // an interrupt woke up something more urgent than what
+        // it interrupted: switch to it, once the handler returns
+        if (interrupt->isInHandler() && p > QueueOf(currentThread))
+            interrupt->YieldOnReturn();
+    }
+    if (timer != NULL && timer->isOnDemand())
+        timer->Start(); // there is now someone to time-slice with
 }
 
 //----------------------------------------------------------------------
@@ -67,13 +272,587 @@ void Scheduler::ReadyToRun(Thread *thread)
 // 	Return the next thread to be scheduled onto the CPU.
 //	If there are no ready threads, return NULL.
 // Side effect:
-//	Thread is removed from the ready list.
+//	Thread is removed from the ready list, and how long it waited
+//	there is counted in the statistics.  With -tickless, if that
+//	leaves the list empty, the timer is stopped until a thread is
+//	ready again.
 //----------------------------------------------------------------------
 
 Thread *
 Scheduler::FindNextToRun()
 {
-    return (Thread *)readyList->Remove();
+    Thread *next;
+
+    if (policy == MLFQPolicy && stats->totalTicks >= nextReset)
+        ResetLevels();
+    if (!realTimeList->IsEmpty())
+    { // the one whose job is due first
+        next = (Thread *)realTimeList->Remove();
+        stats->readyWait.EnterLog(stats->totalTicks - next->getReadyTime());
+        return next;
+    }
+    if (numReady == 0)
+        return NULL;
+    if (policy == FIFOPolicy && numCPUs > 1)
+    {
+        next = NextForCPU(TRUE);
+        if (next == NULL)
+            return NULL; // the ready ones must run on other CPUs
+    }
+    else if (policy == FIFOPolicy)
+        next = (Thread *)readyList->Remove();
+    else if (policy == FairSharePolicy)
+    {
+        next = FairPop();
+        if (next->vruntime > minVruntime)
+            minVruntime = next->vruntime;
+    }
+    else
+    {
+        int p = HighestBit(readyPriorities);
+
+        next = queueHead[p];
+        queueHead[p] = next->nextReady;
+        if (queueHead[p] == NULL)
+            readyPriorities &= ~(1U << p);
+        next->nextReady = NULL;
+    }
+    numReady--;
+    if (policy == MLFQPolicy)
+        Refresh(next);
+
+    stats->readyWait.EnterLog(stats->totalTicks - next->getReadyTime());
+    if (timer != NULL && timer->isOnDemand() && numReady == 0)
+        timer->Stop(); // nothing else to switch to
+    return next;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldYield
+// 	Return TRUE if "thread", the one running, should give up the CPU
+//	when it offers to (in Thread::Yield): if any thread is ready, or
+//	with priorities, if one of at least the same priority is.  Only
+//	a real-time thread due no later is good enough for a real-time
+//	thread; any is for the others.  With more than one CPU, it must
+//	be one this CPU can run.
+//----------------------------------------------------------------------
+
+bool Scheduler::ShouldYield(Thread *thread)
+{
+    if (!realTimeList->IsEmpty() &&
+        (thread->period == 0 ||
+         realTimeList->firstElement()->key <= thread->deadline))
+        return TRUE;
+    if (thread->period > 0 || numReady == 0)
+        return FALSE;
+    if (policy == FIFOPolicy && numCPUs > 1)
+        return NextForCPU(FALSE) != NULL;
+    if (policy == FIFOPolicy || policy == FairSharePolicy)
+        return TRUE;
+    return HighestBit(readyPriorities) >= QueueOf(thread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+// 	Return TRUE if the running thread's time slice is up, so the
+//	timer interrupt handler should make it yield.  Only the MLFQ and
+//	the fair-share scheduler keep track: otherwise, every timer
+//	interrupt ends a slice.
+//
+//	With the MLFQ, the slice is up if a thread at a higher level is
+//	waiting, or the thread has used up its quantum (and so moved down
+//	a level, unless it is at the bottom) and one at its own level is:
+//	threads at the same level take turns.  With fair shares, it is up if a ready thread
+//	has had less (weighted) CPU time.  A real-time thread isn't time
+//	sliced, but gives way to one due sooner, as any other thread does
+//	to any real-time one.
+//----------------------------------------------------------------------
+
+bool Scheduler::ShouldPreempt()
+{
+    int level;
+    bool sliceUp;
+
+    if (!realTimeList->IsEmpty() &&
+        PreemptsCurrent((Thread *)realTimeList->firstElement()->item))
+        return TRUE;
+    if (currentThread->period > 0)
+        return FALSE;
+    if (policy == FairSharePolicy)
+    {
+        Charge(currentThread);
+        return numReady > 0 && FairBefore(fairHeap[0], currentThread);
+    }
+    if (policy != MLFQPolicy)
+        return TRUE;
+    if (stats->totalTicks >= nextReset)
+        ResetLevels();
+    Refresh(currentThread);
+    sliceUp = Charge(currentThread);
+    if (numReady == 0)
+        return FALSE;
+    level = HighestBit(readyPriorities);
+    return level > currentThread->level ||
+           (sliceUp && level == currentThread->level);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::AdmitPeriodic
+// 	Make "thread" a real-time thread (see Thread::SetPeriodic), with
+//	its first job starting now -- unless the real-time threads could
+//	then need more than all of the CPU, when EDF would no longer be
+//	sure to meet every deadline; then return FALSE.  Real-time threads
+//	are only supported on one CPU.
+//
+//	"thread" must be running, or not yet forked, so that it isn't on
+//	any of the other ready queues.
+//----------------------------------------------------------------------
+
+bool Scheduler::AdmitPeriodic(Thread *thread, int period, int budget)
+{
+    double share = (double)budget / period;
+
+    ASSERT(thread == currentThread || thread->getStatus() == JUST_CREATED);
+    if (numCPUs > 1)
+    {
+        DEBUG('t', "Thread \"%s\" not admitted: more than one CPU\n",
+              thread->getName());
+        return FALSE;
+    }
+    if (utilization + share > 1.0 + 1e-9) // (allow for rounding)
+    {
+        DEBUG('t', "Thread \"%s\" not admitted: the CPU is %.0f%% taken\n",
+              thread->getName(), utilization * 100);
+        return FALSE;
+    }
+    utilization += share;
+    if (thread == currentThread)
+        Charge(thread); // its time so far isn't real-time
+
+    thread->period = period;
+    thread->budget = thread->budgetLeft = budget;
+    thread->deadline = stats->totalTicks + period;
+    thread->jobDone = thread->throttled = thread->late = FALSE;
+    thread->release = interrupt->Schedule(ReleaseHandler, (_int)thread,
+                                          period, SchedulerInt);
+    if (thread == currentThread)
+    {
+        ASSERT(!budgetTimer.IsSet());
+        budgetTimer = interrupt->Schedule(BudgetHandler, 0, budget,
+                                          SchedulerInt);
+    }
+    DEBUG('t', "Thread \"%s\" is real-time: %d ticks every %d\n",
+          thread->getName(), budget, period);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RemovePeriodic
+// 	"thread", a real-time thread, is finishing: give back its share
+//	of the CPU, and stop its jobs.
+//----------------------------------------------------------------------
+
+void Scheduler::RemovePeriodic(Thread *thread)
+{
+    utilization -= (double)thread->budget / thread->period;
+    interrupt->Cancel(thread->release);
+    thread->release = IntHandle();
+    thread->period = 0;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Release
+// 	Called when the period of real-time "thread" is over, so its job
+//	is due: count whether it was done in time, and give it its next
+//	job, with a new budget.  If it was waiting for that, it is ready
+//	again; if it is late, it carries on with the job it has, and has
+//	until the end of this period to catch up.
+//----------------------------------------------------------------------
+
+void Scheduler::Release(Thread *thread)
+{
+    bool running = (thread == currentThread && thread->getStatus() == RUNNING);
+
+    if (running)
+        Charge(thread); // to the job that is due
+    if (thread->jobDone)
+        stats->numJobsOnTime++;
+    else
+    {
+        DEBUG('t', "Thread \"%s\" missed its deadline, at %d\n",
+              thread->getName(), thread->deadline);
+        stats->numDeadlineMisses++;
+        thread->late = TRUE;
+    }
+    thread->deadline += thread->period;
+    thread->budgetLeft = thread->budget;
+    thread->release = interrupt->Schedule(ReleaseHandler, (_int)thread,
+        max(thread->deadline - stats->totalTicks, 1), SchedulerInt);
+
+    if (thread->jobDone || thread->throttled)
+    {
+        thread->jobDone = thread->throttled = FALSE;
+        ReadyToRun(thread);
+    }
+    else if (thread->getStatus() == READY)
+    { // its place in line has changed
+        for (ListElement *e = realTimeList->firstElement(); e != NULL;
+             e = e->next)
+            if (e->item == (void *)thread)
+            {
+                realTimeList->RemoveItem(e);
+                break;
+            }
+        realTimeList->SortedInsert((void *)thread, thread->deadline);
+        if (PreemptsCurrent(thread)) // it may never have had the CPU
+            interrupt->YieldOnReturn();
+    }
+    else if (running)
+    { // its budget starts again, but another job may now be due first
+        if (budgetTimer.IsSet())
+            interrupt->Cancel(budgetTimer);
+        budgetTimer = interrupt->Schedule(BudgetHandler, 0, thread->budget,
+                                          SchedulerInt);
+        if (!realTimeList->IsEmpty() &&
+            realTimeList->firstElement()->key < thread->deadline)
+            interrupt->YieldOnReturn();
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::BudgetExpired
+// 	Called when the running thread, if it is real-time, may have
+//	used up the budget of its current job.  If so, make it give up
+//	the CPU when the handler returns, and see Throttle.
+//----------------------------------------------------------------------
+
+void Scheduler::BudgetExpired()
+{
+    Thread *thread = currentThread;
+
+    budgetTimer = IntHandle(); // (it has gone off)
+    if (thread->period == 0 || thread->getStatus() != RUNNING)
+        return; // it was giving up the CPU anyway
+    Charge(thread);
+    if (thread->budgetLeft > 0) // (the machine was idle for some of it)
+        budgetTimer = interrupt->Schedule(BudgetHandler, 0,
+                                          thread->budgetLeft, SchedulerInt);
+    else
+    {
+        DEBUG('t', "Thread \"%s\" has used up its budget\n",
+              thread->getName());
+        interrupt->YieldOnReturn();
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Throttle
+// 	Return TRUE if "thread", which is yielding, is a real-time thread
+//	that has used up its budget; then it is to sleep, instead of
+//	being made ready, until Release gives it the next one.
+//----------------------------------------------------------------------
+
+bool Scheduler::Throttle(Thread *thread)
+{
+    if (thread->period == 0)
+        return FALSE;
+    Charge(thread);
+    if (thread->budgetLeft > 0)
+        return FALSE;
+    thread->throttled = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::PreemptsCurrent
+// 	Return TRUE if real-time "thread" should run instead of the
+//	thread that is running: that one isn't real-time, or its job is
+//	due later.
+//----------------------------------------------------------------------
+
+bool Scheduler::PreemptsCurrent(Thread *thread)
+{
+    return currentThread->period == 0 ||
+           thread->deadline < currentThread->deadline;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::QueueOf
+// 	Return which run queue "thread" goes in: its priority, or with
+//	the MLFQ, its level.
+//----------------------------------------------------------------------
+
+int Scheduler::QueueOf(Thread *thread)
+{
+    return (policy == MLFQPolicy) ? thread->level : thread->getPriority();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::CPUFor
+// 	With more than one CPU, return which one's queue "thread" goes
+//	in: the CPU it is bound to; or the one idling in it, since that
+//	is using its stack; or an idle one; or failing those, this one.
+//----------------------------------------------------------------------
+
+int Scheduler::CPUFor(Thread *thread)
+{
+    if (thread->cpu >= 0)
+        return thread->cpu;
+    for (int i = 0; i < numCPUs; i++)
+        if (idleIn[i] == thread)
+            return i;
+    for (int i = 0; i < numCPUs; i++)
+        if (idleIn[i] != NULL)
+            return i;
+    return currentCPU;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::NextForCPU
+// 	With more than one CPU, return the thread this one should run
+//	next: the first on its own queue, or if that is empty, the first
+//	on another's that can run anywhere (and isn't the one that CPU is
+//	idling in).  Return NULL if there is none.
+//
+//	"take" -- if TRUE, remove it from its queue
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::NextForCPU(bool take)
+{
+    for (int i = 0; i < numCPUs; i++)
+    {
+        int cpu = (currentCPU + i) % numCPUs;
+
+        for (ListElement *e = cpuQueue[cpu]->firstElement(); e != NULL;
+             e = e->next)
+        {
+            Thread *thread = (Thread *)e->item;
+
+            if (cpu != currentCPU &&
+                (thread->cpu >= 0 || thread == idleIn[cpu]))
+                continue; // it can only run there
+            if (take)
+                cpuQueue[cpu]->RemoveItem(e);
+            return thread;
+        }
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Idle
+// 	Called when no thread is ready for this CPU to run: wait for an
+//	interrupt to make one ready.  With more than one CPU, only the
+//	last one to be left with nothing to do does that, since only the
+//	work being done should move the clock on; the others wait for a
+//	thread to be put on their queue, or to be the last.  Either way,
+//	the caller must look for a thread to run again when this returns.
+//----------------------------------------------------------------------
+
+void Scheduler::Idle()
+{
+#ifdef USER_PROGRAM
+    bool othersIdle = TRUE;
+
+    for (int i = 0; i < numCPUs; i++)
+        if (i != currentCPU && idleIn[i] == NULL)
+            othersIdle = FALSE;
+    if (numCPUs > 1 && (numReady > 0 || !othersIdle))
+    {
+        idleIn[currentCPU] = currentThread;
+        WaitForWork();
+        idleIn[currentCPU] = NULL;
+        return;
+    }
+#endif
+    interrupt->Idle();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Count the CPU time "thread" has had since it was last charged (it
+//	is, or was just, running).  Idle time isn't counted.
+//
+//	A real-time thread's time comes out of its budget.  Otherwise,
+//	with fair shares, the time is added to its virtual runtime,
+//	scaled by its weight; with the MLFQ, it is added to its time at
+//	its level, and if that is the level's quantum, the thread starts
+//	a new one, a level down if there is one.  Returns TRUE in that
+//	case (the thread's slice is up).
+//----------------------------------------------------------------------
+
+bool Scheduler::Charge(Thread *thread)
+{
+    int now = stats->totalTicks - stats->idleTicks;
+    int used = now - sliceStart;
+    int quantum;
+
+    sliceStart = now;
+    if (thread->period > 0)
+    {
+        thread->budgetLeft -= used;
+        return FALSE;
+    }
+    if (policy == FairSharePolicy)
+    {
+        if (thread->getStatus() != TERMINATED) // (its space may be gone)
+            thread->vruntime += (double)used * NormalWeight / WeightOf(thread);
+        return FALSE;
+    }
+    if (policy != MLFQPolicy)
+        return FALSE;
+    Refresh(thread);
+    quantum = TimerTicks << (NumPriorities - 1 - thread->level);
+    thread->usedTicks += used;
+    if (thread->usedTicks < quantum)
+        return FALSE;
+    thread->usedTicks = 0;
+    if (thread->level > NumPriorities - MLFQLevels)
+    {
+        DEBUG('t', "Thread \"%s\" moves down to level %d\n",
+              thread->getName(), thread->level - 1);
+        thread->level--;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::WeightOf
+// 	Return the share of the CPU "thread" is entitled to: NormalWeight,
+//	or if its address space is in a group, its part of the group's.
+//----------------------------------------------------------------------
+
+int Scheduler::WeightOf(Thread *thread)
+{
+#ifdef USER_PROGRAM
+    if (thread->space != NULL && thread->space->group != NULL)
+    {
+        SchedGroup *group = thread->space->group;
+        int weight = group->weight / group->members;
+
+        return (weight > 0) ? weight : 1;
+    }
+#endif
+    return NormalWeight;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FairBefore
+// 	Return TRUE if "a" should run before "b": it has had less CPU
+//	time, or as much, and has been ready longer.
+//----------------------------------------------------------------------
+
+bool Scheduler::FairBefore(Thread *a, Thread *b)
+{
+    if (a->vruntime != b->vruntime)
+        return a->vruntime < b->vruntime;
+    return a->getReadyTime() < b->getReadyTime();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FairPush
+// 	Add "thread" to the heap of ready threads (numReady already
+//	counts it), sifting it up past those it should run before.
+//----------------------------------------------------------------------
+
+void Scheduler::FairPush(Thread *thread)
+{
+    int i = numReady - 1;
+
+    if (numReady > maxFair)
+    { // out of room; double it
+        Thread **bigger = new Thread *[2 * maxFair];
+
+        for (int j = 0; j < i; j++)
+            bigger[j] = fairHeap[j];
+        delete[] fairHeap;
+        fairHeap = bigger;
+        maxFair *= 2;
+    }
+    while (i > 0 && FairBefore(thread, fairHeap[(i - 1) / 2]))
+    {
+        fairHeap[i] = fairHeap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    fairHeap[i] = thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FairPop
+// 	Remove and return the thread at the top of the heap (there must
+//	be one; numReady still counts it), moving the last one into its
+//	place and sifting that down.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::FairPop()
+{
+    Thread *top = fairHeap[0];
+    Thread *last = fairHeap[numReady - 1];
+    int size = numReady - 1;
+    int i = 0;
+
+    for (;;)
+    {
+        int child = 2 * i + 1;
+
+        if (child >= size)
+            break;
+        if (child + 1 < size && FairBefore(fairHeap[child + 1], fairHeap[child]))
+            child++;
+        if (!FairBefore(fairHeap[child], last))
+            break;
+        fairHeap[i] = fairHeap[child];
+        i = child;
+    }
+    if (size > 0)
+        fairHeap[i] = last;
+    return top;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Refresh
+// 	If the queues were reset since "thread" was last looked at (or
+//	it's new), put it at the top level, with no time used.
+//----------------------------------------------------------------------
+
+void Scheduler::Refresh(Thread *thread)
+{
+    if (thread->epoch != epoch)
+    {
+        thread->epoch = epoch;
+        thread->level = NumPriorities - 1;
+        thread->usedTicks = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ResetLevels
+// 	Put every thread back at the top level.  The ready threads are
+//	moved to the top queue, in the order they would have run; the
+//	others are moved when next seen (see Refresh).
+//----------------------------------------------------------------------
+
+void Scheduler::ResetLevels()
+{
+    int top = NumPriorities - 1;
+
+    DEBUG('t', "Resetting the MLFQ levels\n");
+    epoch++;
+    nextReset = stats->totalTicks + MLFQResetTicks;
+    for (int p = top - 1; p > top - MLFQLevels; p--)
+    {
+        if (queueHead[p] == NULL)
+            continue;
+        if (queueHead[top] == NULL)
+            queueHead[top] = queueHead[p];
+        else
+            queueTail[top]->nextReady = queueHead[p];
+        queueTail[top] = queueTail[p];
+        queueHead[p] = queueTail[p] = NULL;
+    }
+    readyPriorities = (numReady > 0) ? 1U << top : 0;
 }
 
 //----------------------------------------------------------------------
@@ -105,11 +884,23 @@ void Scheduler::Run(Thread *nextThread)
     oldThread->CheckOverflow(); // check if the old thread
                                 // had an undetected stack overflow
 
+    Charge(oldThread); // (the next thread's time starts now)
+    if (budgetTimer.IsSet())
+    { // the old thread's budget stops running out
+        interrupt->Cancel(budgetTimer);
+        budgetTimer = IntHandle();
+    }
+    if (nextThread->period > 0) // and the new one's starts
+        budgetTimer = interrupt->Schedule(BudgetHandler, 0,
+            max(nextThread->budgetLeft, 1), SchedulerInt);
+
     currentThread = nextThread;        // switch to the next thread
     currentThread->setStatus(RUNNING); // nextThread is now running
 
     DEBUG('t', "Switching from thread \"%s\" to thread \"%s\"\n",
           oldThread->getName(), nextThread->getName());
+    if (timeline != NULL)
+        timeline->Switch(nextThread->getTrack());
 
     // This is a machine-dependent assembly language routine defined
     // in switch.s.  You may have to think
@@ -124,11 +915,7 @@ void Scheduler::Run(Thread *nextThread)
     // we need to delete its carcass.  Note we cannot delete the thread
     // before now (for example, in Thread::Finish()), because up to this
     // point, we were still running on the old thread's stack!
-    if (threadToBeDestroyed != NULL)
-    {
-        delete threadToBeDestroyed;
-        threadToBeDestroyed = NULL;
-    }
+    CheckToBeDestroyed();
 
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL)
@@ -139,6 +926,23 @@ void Scheduler::Run(Thread *nextThread)
 #endif
 }
 
+//----------------------------------------------------------------------
+// Scheduler::CheckToBeDestroyed
+// 	Delete the thread that finished just before the switch to this
+//	one, if any.  Called by Run, once SWITCH returns, and by a new
+//	thread as it starts (see ThreadBegin), since SWITCH doesn't
+//	return to Run in that case.
+//----------------------------------------------------------------------
+
+void Scheduler::CheckToBeDestroyed()
+{
+    if (threadToBeDestroyed != NULL)
+    {
+        delete threadToBeDestroyed;
+        threadToBeDestroyed = NULL;
+    }
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Print
 // 	Print the scheduler state -- in other words, the contents of
@@ -147,7 +951,17 @@ void Scheduler::Run(Thread *nextThread)
 void Scheduler::Print()
 {
     printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr)ThreadPrint);
+    realTimeList->Mapcar((VoidFunctionPtr)ThreadPrint);
+    if (policy == FIFOPolicy)
+        for (int i = 0; i < numCPUs; i++) // (each CPU's queue in turn)
+            cpuQueue[i]->Mapcar((VoidFunctionPtr)ThreadPrint);
+    else if (policy == FairSharePolicy)
+        for (int i = 0; i < numReady; i++) // (in heap order)
+            fairHeap[i]->Print();
+    else
+        for (int p = NumPriorities - 1; p >= 0; p--)
+            for (Thread *t = queueHead[p]; t != NULL; t = t->nextReady)
+                t->Print();
 }
 
 
@@ -13,6 +13,46 @@
 #include "list.h"
 #include "thread.h"
 
+// The ways the scheduler can choose which ready thread runs next.
+
+enum SchedPolicy {
+  FIFOPolicy,    // the one that has been ready longest
+  PriorityPolicy, // the one with the highest priority (FIFO among
+                  // equals); one made ready by an interrupt handler
+                  // preempts a thread of lower priority
+  MLFQPolicy,     // multi-level feedback queue: the same, but the
+                  // scheduler sets the priorities, from how much CPU
+                  // time each thread uses (see scheduler.cc)
+  FairSharePolicy // the one that has had the least CPU time, weighted
+                  // by its share (see SchedGroup)
+};
+
+#define MLFQLevels 4 // MLFQPolicy's queues, the top NumPriorities
+#define MLFQResetTicks (100 * TimerTicks) // how often every thread is
+                     // put back in the top queue
+
+#define NormalWeight 1024 // FairSharePolicy: the CPU share of a thread
+                          // on its own
+
+// The following class defines a group of address spaces that share
+// the CPU as one, under FairSharePolicy: an address space made by Exec
+// joins its parent's group, so a process can't get more of the CPU by
+// starting more of them.  The group's weight is divided evenly among
+// its members; a thread in no group has NormalWeight.
+
+class SchedGroup
+{
+public:
+  SchedGroup(int groupWeight = NormalWeight)
+  {
+    weight = groupWeight;
+    members = 0;
+  }
+
+  int weight;  // its share of the CPU, relative to other groups
+  int members; // # of address spaces in it
+};
+
 // The following class defines the scheduler/dispatcher abstraction --
 // the data structures and operations needed to keep track of which
 // thread is running, and which threads are ready but not running.
@@ -20,18 +60,95 @@
 class Scheduler
 {
 public:
-  Scheduler();  // Initialize list of ready threads
-  ~Scheduler(); // De-allocate ready list
+  Scheduler(SchedPolicy whichPolicy = FIFOPolicy);
+                                              // Initialize list of
+                                              // ready threads
+  ~Scheduler();                               // De-allocate ready list
 
   void ReadyToRun(Thread *thread); // Thread can be dispatched.
   Thread *FindNextToRun();         // Dequeue first thread on the ready
                                    // list, if any, and return thread.
+  bool ShouldYield(Thread *thread); // Is a ready thread entitled to
+                                    // the CPU, if "thread" offers it?
+  bool ShouldPreempt();             // Should the timer take the CPU
+                                    // from the running thread?
+  bool AdmitPeriodic(Thread *thread, int period, int budget);
+                                    // Make "thread" real-time, if the
+                                    // CPU can fit it in
+  void RemovePeriodic(Thread *thread); // "thread" has no more jobs
+  void Release(Thread *thread);     // Start its next job
+  void BudgetExpired();             // The running thread's budget may
+                                    // be used up
+  bool Throttle(Thread *thread);    // Has "thread", which is yielding,
+                                    // used up its budget?
+  void Idle();                     // No thread is ready: wait for one
   void Run(Thread *nextThread);    // Cause nextThread to start running
+  void CheckToBeDestroyed();       // Delete the thread that just
+                                   // finished, if any
   void Print();                    // Print contents of ready list
+  bool IsEmpty() // no thread is ready
+  {
+    return numReady == 0 && realTimeList->IsEmpty();
+  }
 
 private:
-  List *readyList; // queue of threads that are ready to run,
-                   // but not running
+  SchedPolicy policy; // how to choose the next thread
+  int numReady;       // # of threads that are ready (other than
+                      // real-time ones)
+  List *readyList;    // queue of threads that are ready to run,
+                      // but not running (FIFOPolicy)
+
+  // with more than one CPU (see userprog/smp.h), each has a FIFO queue
+  // of its own (readyList is CPU 0's); and if it is idle, waiting for
+  // a thread to be put there, the thread it is waiting in (else NULL)
+  List **cpuQueue;
+  Thread **idleIn;
+
+  // PriorityPolicy: a queue of ready threads for each priority,
+  // linked through Thread::nextReady, and a bitmap of the priorities
+  // whose queue isn't empty, so that the highest can be found at once
+  Thread *queueHead[NumPriorities];
+  Thread *queueTail[NumPriorities];
+  unsigned int readyPriorities; // bit "p" is set if queue "p" isn't empty
+
+  // when the running thread's time began to be counted, in busy (not
+  // idle) ticks (MLFQPolicy and FairSharePolicy)
+  int sliceStart;
+
+  // MLFQPolicy: how many times, and when next, all threads are put
+  // back in the top queue
+  int epoch;
+  int nextReset;
+
+  // FairSharePolicy: the ready threads, as a binary heap ordered by
+  // Thread::vruntime (the least at fairHeap[0]), and a lower bound on
+  // the vruntime of every thread that is ready or running
+  Thread **fairHeap;
+  int maxFair; // size of "fairHeap"
+  double minVruntime;
+
+  // real-time threads: those that are ready, in order of deadline,
+  // all run before any other thread; the share of the CPU they have
+  // been admitted for; and the interrupt that ends the running one's
+  // budget, if it is real-time
+  List *realTimeList;
+  double utilization;
+  IntHandle budgetTimer;
+
+  bool PreemptsCurrent(Thread *thread); // should real-time "thread"
+                                        // have the CPU instead?
+  int QueueOf(Thread *thread); // which queue "thread" belongs in
+  int CPUFor(Thread *thread);  // which CPU's queue it belongs in
+  Thread *NextForCPU(bool take); // the thread this CPU should run
+                                 // next, if any; removed if "take"
+  bool Charge(Thread *thread); // count the CPU time it has used;
+                               // TRUE if its quantum is up
+  int WeightOf(Thread *thread); // its share of the CPU
+  bool FairBefore(Thread *a, Thread *b); // should "a" run before "b"?
+  void FairPush(Thread *thread); // add "thread" to fairHeap
+  Thread *FairPop();             // take the least off it
+  void Refresh(Thread *thread); // MLFQ: catch up with any reset
+  void ResetLevels();           // MLFQ: put everyone in the top queue
 #ifdef USER_PROGRAM
 private:
     List *waitingList;    // queue of threads that are waiting
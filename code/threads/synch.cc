@@ -129,9 +129,14 @@ Lock::~Lock()
 void Lock::Acquire()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff); // disable interrupts
+    bool waiting = (owner != NULL);      // someone else has it
+    int start = stats->totalTicks;
+    double hostStart = (timeline != NULL) ? HostSeconds() : 0;
 
     lock->P();                           // procure the semaphore
     owner = currentThread;               // record the new owner of the lock
+    if (waiting && timeline != NULL)
+        timeline->LockWait(currentThread->getTrack(), name, start, hostStart);
     (void)interrupt->SetLevel(oldLevel); // re-enable interrupts
 }
 
@@ -19,6 +19,9 @@ Interrupt *interrupt;        // interrupt status
 Statistics *stats;           // performance metrics
 Timer *timer;                // the hardware timer device,
                              // for invoking context switches
+Timeline *timeline;          // where to record kernel events, if at all
+int numCPUs = 1;             // CPUs running user programs at once
+int currentCPU = 0;          // the one running the kernel
 
 #ifdef FILESYS_NEEDED
 FileSystem *fileSystem;
@@ -30,6 +33,7 @@ SynchDisk *synchDisk;
 
 #ifdef USER_PROGRAM // requires either FILESYS or FILESYS_STUB
 Machine *machine;   // user program memory and registers
+Profiler *profiler; // user program execution counts, if -profile
 #endif
 
 #ifdef NETWORK
@@ -39,6 +43,10 @@ PostOffice *postOffice;
 // External definition, to allow us to take a pointer to this function
 extern void Cleanup();
 
+#ifdef USER_PROGRAM
+extern void ScheduleCheckpoint(char *fileName, int when);
+#endif
+
 //----------------------------------------------------------------------
 // TimerInterruptHandler
 // 	Interrupt handler for the timer device.  The timer device is
@@ -51,7 +59,8 @@ extern void Cleanup();
 //	which is what we wanted to context switch), we set a flag
 //	so that once the interrupt handler is done, it will appear as
 //	if the interrupted thread called Yield at the point it is
-//	was interrupted.
+//	was interrupted.  (The scheduler may keep track of time slices
+//	itself, and let the thread go on.)
 //
 //	"dummy" is because every interrupt handler takes one argument,
 //		whether it needs it or not.
@@ -59,7 +68,7 @@ extern void Cleanup();
 static void
 TimerInterruptHandler(_int dummy)
 {
-    if (interrupt->getStatus() != IdleMode)
+    if (interrupt->getStatus() != IdleMode && scheduler->ShouldPreempt())
         interrupt->YieldOnReturn();
 }
 
@@ -78,9 +87,18 @@ void Initialize(int argc, char **argv)
     int argCount;
     char *debugArgs = "";
     bool randomYield = FALSE;
+    bool tickless = FALSE; // time-slice only when others are ready
+    char *statsFile = NULL; // where to dump statistics at halt
+    char *timelineFile = NULL; // where to record kernel events
+    SchedPolicy policy = FIFOPolicy; // how to pick the next thread
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE; // single step user program
+    ExecEngine engine = InterpretEngine; // how to run user instructions
+    bool profile = FALSE;       // count user instructions
+    char *checkpointFile = NULL; // where to save the user program,
+    int checkpointTime = 0;      // and when
+    char *traceFile = NULL;      // where to record the execution
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE; // format disk
@@ -112,9 +130,135 @@ void Initialize(int argc, char **argv)
             randomYield = TRUE;
             argCount = 2;
         }
+        else if (!strcmp(*argv, "-tickless"))
+            tickless = TRUE;
+        else if (!strcmp(*argv, "-stats"))
+        {
+            ASSERT(argc > 1);
+            statsFile = *(argv + 1);
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-timeline"))
+        {
+            ASSERT(argc > 1);
+            timelineFile = *(argv + 1);
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-sched"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "priority"))
+                policy = PriorityPolicy;
+            else if (!strcmp(*(argv + 1), "mlfq"))
+                policy = MLFQPolicy;
+            else if (!strcmp(*(argv + 1), "fair"))
+                policy = FairSharePolicy;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "fifo"));
+                policy = FIFOPolicy;
+            }
+            argCount = 2;
+        }
 #ifdef USER_PROGRAM
         if (!strcmp(*argv, "-s"))
             debugUserProg = TRUE;
+        else if (!strcmp(*argv, "-engine"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "threaded"))
+                engine = ThreadedEngine;
+            else if (!strcmp(*(argv + 1), "block"))
+                engine = BlockEngine;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "interp"));
+                engine = InterpretEngine;
+            }
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-profile"))
+            profile = TRUE;
+        else if (!strcmp(*argv, "-mem"))
+        { // set the machine geometry, before the Machine is made
+            ASSERT(argc > 1);
+            numPhysPages = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-pagesize"))
+        {
+            ASSERT(argc > 1);
+            pageSize = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-memfile"))
+        {
+            ASSERT(argc > 1);
+            memoryFile = *(argv + 1);
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-tlbsize"))
+        {
+            ASSERT(argc > 1);
+            tlbSize = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-tlbways"))
+        {
+            ASSERT(argc > 1);
+            tlbWays = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-tlbpolicy"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "lru"))
+                tlbPolicy = TLBLRU;
+            else if (!strcmp(*(argv + 1), "plru"))
+                tlbPolicy = TLBPseudoLRU;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "random"));
+                tlbPolicy = TLBRandom;
+            }
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-tlbasid"))
+            tlbASIDs = TRUE;
+        else if (!strcmp(*argv, "-pagetable"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "twolevel"))
+                pageTableKind = TwoLevelTable;
+            else if (!strcmp(*(argv + 1), "inverted"))
+                pageTableKind = InvertedTable;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "linear"));
+                pageTableKind = LinearTable;
+            }
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-trace"))
+        {
+            ASSERT(argc > 1);
+            traceFile = *(argv + 1);
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-checkpoint"))
+        {
+            ASSERT(argc > 2);
+            checkpointFile = *(argv + 1);
+            checkpointTime = atoi(*(argv + 2));
+            argCount = 3;
+        }
+        else if (!strcmp(*argv, "-cpus"))
+        { // before the Scheduler is made
+            ASSERT(argc > 1);
+            numCPUs = atoi(*(argv + 1));
+            ASSERT(numCPUs > 0);
+            argCount = 2;
+        }
 #endif
 #ifdef FILESYS_NEEDED
         if (!strcmp(*argv, "-f"))
@@ -142,12 +286,27 @@ void Initialize(int argc, char **argv)
 #endif
     }
 
+#ifdef USER_PROGRAM
+    if (numCPUs > 1 &&
+        (policy != FIFOPolicy || debugUserProg || traceFile != NULL ||
+         checkpointFile != NULL || pageTableKind == InvertedTable))
+    {
+        fprintf(stderr, "-cpus only works with the FIFO scheduler, and not "
+                        "with -s, -trace, -checkpoint or -pagetable inverted\n");
+        Exit(1);
+    }
+#endif
+
     DebugInit(debugArgs);        // initialize DEBUG messages
     stats = new Statistics();    // collect statistics
+    stats->dumpFile = statsFile;
+    if (timelineFile != NULL)    // before any thread is made
+        timeline = new Timeline(timelineFile);
     interrupt = new Interrupt;   // start up interrupt handling
-    scheduler = new Scheduler(); // initialize the ready queue
-    if (randomYield)             // start the timer (if needed)
-        timer = new Timer(TimerInterruptHandler, 0, randomYield);
+    scheduler = new Scheduler(policy); // initialize the ready queue
+    // start the timer (if needed)
+    if (randomYield || policy == MLFQPolicy || policy == FairSharePolicy)
+        timer = new Timer(TimerInterruptHandler, 0, randomYield, tickless);
 
     threadToBeDestroyed = NULL;
 
@@ -161,7 +320,19 @@ void Initialize(int argc, char **argv)
     CallOnUserAbort(Cleanup); // if user hits ctl-C
 
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg); // this must come first
+    machine = new Machine(debugUserProg, engine); // this must come first
+    profiler = NULL;
+    if (profile)
+    {
+        profiler = new Profiler();
+        machine->EnableProfile();
+    }
+    if (traceFile != NULL)
+        machine->EnableTrace(traceFile);
+    if (checkpointFile != NULL)
+        ScheduleCheckpoint(checkpointFile, checkpointTime);
+    if (numCPUs > 1)
+        StartCPUs(engine); // (they wait for us to run user code)
 #endif
 
 #ifdef FILESYS
@@ -189,7 +360,11 @@ void Cleanup()
 #endif
 
 #ifdef USER_PROGRAM
-    delete machine;
+    if (numCPUs == 1)
+    { // (otherwise, other CPUs may still be running user code)
+        delete profiler;
+        delete machine;
+    }
 #endif
 
 #ifdef FILESYS_NEEDED
@@ -200,6 +375,7 @@ void Cleanup()
     delete synchDisk;
 #endif
 
+    delete timeline;
     delete timer;
     delete scheduler;
     delete interrupt;
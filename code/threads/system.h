@@ -15,6 +15,7 @@
 #include "interrupt.h"
 #include "stats.h"
 #include "timer.h"
+#include "timeline.h"
 
 // Initialization and cleanup routines
 extern void Initialize(int argc, char **argv); 	// Initialization,
@@ -28,10 +29,16 @@ extern Scheduler *scheduler;			// the ready list
 extern Interrupt *interrupt;			// interrupt status
 extern Statistics *stats;			// performance metrics
 extern Timer *timer;				// the hardware alarm clock
+extern Timeline *timeline;			// kernel events, if -timeline
+extern int numCPUs;				// # of CPUs (-cpus)
+extern int currentCPU;				// the one in the kernel
 
 #ifdef USER_PROGRAM
 #include "machine.h"
+#include "profile.h"
+#include "smp.h"
 extern Machine* machine;	// user program memory and registers
+extern Profiler* profiler;	// user program execution counts
 #endif
 
 #ifdef FILESYS_NEEDED 		// FILESYS or FILESYS_STUB 
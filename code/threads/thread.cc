@@ -24,20 +24,89 @@
                                    // execution stack, for detecting
                                    // stack overflows
 
+// The stacks of threads that have been deleted, kept for new threads
+// to use, since making one takes several system calls (to map it, and
+// to set up the guard pages at its ends).  Their pages are given back
+// to the host as they go in (see DiscardBoundedArray), so the pool
+// only holds on to address space.  The most recently used are at the
+// end, and used first.
+
+static int *freeStacks[StackPoolSize];
+static int freeStackSizes[StackPoolSize]; // their sizes, in words
+static int numFreeStacks = 0;
+
+//----------------------------------------------------------------------
+// GetStack
+// 	Return a stack of "size" words: one from the pool, if there is
+//	one that size, or else a new one.
+//----------------------------------------------------------------------
+
+static int *
+GetStack(int size)
+{
+    for (int i = numFreeStacks - 1; i >= 0; i--)
+        if (freeStackSizes[i] == size)
+        {
+            int *stack = freeStacks[i];
+
+            numFreeStacks--;
+            for (; i < numFreeStacks; i++)
+            { // close up the gap, in order
+                freeStacks[i] = freeStacks[i + 1];
+                freeStackSizes[i] = freeStackSizes[i + 1];
+            }
+            stats->numStacksReused++;
+            return stack;
+        }
+    stats->numStacksMade++;
+    return (int *)AllocBoundedArray(size * sizeof(_int));
+}
+
+//----------------------------------------------------------------------
+// PutStack
+// 	Keep "stack", of "size" words, in the pool, without its contents
+//	(its guard pages stay as they are), or if the pool is full, give
+//	it back to the host.
+//----------------------------------------------------------------------
+
+static void
+PutStack(int *stack, int size)
+{
+    if (numFreeStacks == StackPoolSize)
+    {
+        DeallocBoundedArray((char *)stack, size * sizeof(_int));
+        stats->numStacksUnmapped++;
+        return;
+    }
+    DiscardBoundedArray((char *)stack, size * sizeof(_int));
+    freeStacks[numFreeStacks] = stack;
+    freeStackSizes[numFreeStacks] = size;
+    numFreeStacks++;
+}
+
 //----------------------------------------------------------------------
 // Thread::Thread
 // 	Initialize a thread control block, so that we can then call
 //	Thread::Fork.
 //
 //	"threadName" is an arbitrary string, useful for debugging.
+//	"stackWords" is the size of the stack it is to have, in words.
 //----------------------------------------------------------------------
 
-Thread::Thread(char *threadName)
+Thread::Thread(char *threadName, int stackWords)
 {
     name = threadName;
     stackTop = NULL;
     stack = NULL;
+    stackSize = stackWords;
     status = JUST_CREATED;
+    priority = NormalPriority;
+    nextReady = NULL;
+    epoch = -1; // not yet in any MLFQ queue
+    vruntime = 0;
+    cpu = -1;
+    period = 0; // not real-time
+    track = (timeline != NULL) ? timeline->NewThread(threadName) : 0;
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -61,7 +130,7 @@ Thread::~Thread()
 
     ASSERT(this != currentThread);
     if (stack != NULL)
-        DeallocBoundedArray((char *)stack, StackSize * sizeof(_int));
+        PutStack(stack, stackSize); // for another thread to use
 }
 
 //----------------------------------------------------------------------
@@ -121,7 +190,7 @@ void Thread::CheckOverflow()
 {
     if (stack != NULL)
 #ifdef HOST_SNAKE // Stacks grow upward on the Snakes
-        ASSERT((unsigned int)stack[StackSize - 1] == STACK_FENCEPOST);
+        ASSERT((unsigned int)stack[stackSize - 1] == STACK_FENCEPOST);
 #else
         ASSERT((unsigned int)*stack == STACK_FENCEPOST);
 #endif
@@ -147,6 +216,10 @@ void Thread::Finish()
 {
     (void)interrupt->SetLevel(IntOff);
     ASSERT(this == currentThread);
+    if (timeline != NULL)
+        timeline->ThreadFinished(track);
+    if (period > 0)
+        scheduler->RemovePeriodic(this); // no more jobs
 
 #ifdef USER_PROGRAM
     List* waitingList = scheduler->getWaitingList();
@@ -179,7 +252,10 @@ void Thread::Finish()
 //	If so, put the thread on the end of the ready list, so that
 //	it will eventually be re-scheduled.
 //
-//	NOTE: returns immediately if no other thread on the ready queue.
+//	NOTE: returns immediately if no other thread on the ready queue
+//	(or, with priorities, none at least as urgent as this one).
+//	A real-time thread that has used up its budget sleeps instead,
+//	until its next job starts.
 //	Otherwise returns when the thread eventually works its way
 //	to the front of the ready list and gets re-scheduled.
 //
@@ -200,15 +276,67 @@ void Thread::Yield()
 
     DEBUG('t', "Yielding thread \"%s\"\n", getName());
 
-    nextThread = scheduler->FindNextToRun();
-    if (nextThread != NULL)
+    if (scheduler->Throttle(this))
+        Sleep(); // until its next job starts
+    else if (scheduler->ShouldYield(this))
     {
+        nextThread = scheduler->FindNextToRun();
         scheduler->ReadyToRun(this);
         scheduler->Run(nextThread);
     }
     (void)interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// Thread::SetPeriodic
+// 	Make this thread a real-time one, which is run ahead of all the
+//	others, earliest deadline first (see scheduler.cc).  Its first
+//	job starts now.  Call before Fork, or from the thread itself.
+//
+//	"newPeriod" -- how often it has a job to do, in ticks; each job is
+//		due by the time the next one starts
+//	"newBudget" -- how much CPU time each job may use; once it is used
+//		up, the thread isn't run again until its next job
+//
+//	Returns FALSE, leaving the thread as it was, if the real-time
+//	threads could then need more than all of the CPU.
+//----------------------------------------------------------------------
+
+bool Thread::SetPeriodic(int newPeriod, int newBudget)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool admitted;
+
+    ASSERT(period == 0); // not already
+    ASSERT(newBudget > 0 && newBudget <= newPeriod);
+    admitted = scheduler->AdmitPeriodic(this, newPeriod, newBudget);
+    (void)interrupt->SetLevel(oldLevel);
+    return admitted;
+}
+
+//----------------------------------------------------------------------
+// Thread::WaitForPeriod
+// 	Called by a real-time thread when its job for this period is
+//	done: sleep until the next one starts (see Scheduler::Release).
+//	If the job was late, the next one has started already.
+//----------------------------------------------------------------------
+
+void Thread::WaitForPeriod()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(this == currentThread && period > 0);
+    DEBUG('t', "Thread \"%s\" is done with its job\n", getName());
+    if (late)
+        late = FALSE; // carry straight on
+    else
+    {
+        jobDone = TRUE;
+        Sleep();
+    }
+    (void)interrupt->SetLevel(oldLevel);
+}
+
 //----------------------------------------------------------------------
 // Thread::Sleep
 // 	Relinquish the CPU, because the current thread is blocked
@@ -217,10 +345,11 @@ void Thread::Yield()
 //	back on the ready queue, so that it can be re-scheduled.
 //
 //	NOTE: if there are no threads on the ready queue, that means
-//	we have no thread to run.  "Interrupt::Idle" is called
+//	we have no thread to run.  "Scheduler::Idle" is called
 //	to signify that we should idle the CPU until the next I/O interrupt
 //	occurs (the only thing that could cause a thread to become
-//	ready to run).
+//	ready to run), or with more than one CPU, until another CPU
+//	gives us a thread.
 //
 //	NOTE: we assume interrupts are already disabled, because it
 //	is called from the synchronization routines which must
@@ -239,13 +368,13 @@ void Thread::Sleep()
 
     status = BLOCKED;
     while ((nextThread = scheduler->FindNextToRun()) == NULL)
-        interrupt->Idle(); // no one to run, wait for an interrupt
+        scheduler->Idle(); // no one to run, wait for an interrupt
 
     scheduler->Run(nextThread); // returns when we've been signalled
 }
 
 //----------------------------------------------------------------------
-// ThreadFinish, InterruptEnable, ThreadPrint
+// ThreadFinish, ThreadBegin, ThreadPrint
 //	Dummy functions because C++ does not allow a pointer to a member
 //	function.  So in order to do this, we create a dummy C function
 //	(which we can pass a pointer to), that then simply calls the
@@ -253,7 +382,11 @@ void Thread::Sleep()
 //----------------------------------------------------------------------
 
 static void ThreadFinish() { currentThread->Finish(); }
-static void InterruptEnable() { interrupt->Enable(); }
+static void ThreadBegin()
+{ // the thread we switched from may have finished
+    scheduler->CheckToBeDestroyed();
+    interrupt->Enable();
+}
 void ThreadPrint(_int arg)
 {
     Thread *t = (Thread *)arg;
@@ -264,7 +397,8 @@ void ThreadPrint(_int arg)
 // Thread::StackAllocate
 //	Allocate and initialize an execution stack.  The stack is
 //	initialized with an initial stack frame for ThreadRoot, which:
-//		enables interrupts
+//		deletes the thread it was switched from, if that finished,
+//		and enables interrupts
 //		calls (*func)(arg)
 //		calls Thread::Finish
 //
@@ -274,19 +408,19 @@ void ThreadPrint(_int arg)
 
 void Thread::StackAllocate(VoidFunctionPtr func, _int arg)
 {
-    stack = (int *)AllocBoundedArray(StackSize * sizeof(_int));
+    stack = GetStack(stackSize);
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
     stackTop = stack + 16; // HP requires 64-byte frame marker
-    stack[StackSize - 1] = STACK_FENCEPOST;
+    stack[stackSize - 1] = STACK_FENCEPOST;
 #else
     // i386 & MIPS & SPARC & ALPHA stack works from high addresses to low addresses
 #ifdef HOST_SPARC
     // SPARC stack must contains at least 1 activation record to start with.
-    stackTop = stack + StackSize - 96;
+    stackTop = stack + stackSize - 96;
 #else // HOST_MIPS  || HOST_i386 || HOST_ALPHA
-    stackTop = stack + StackSize - 4; // -4 to be on the safe side!
+    stackTop = stack + stackSize - 4; // -4 to be on the safe side!
 #ifdef HOST_i386
                                       // the 80386 passes the return address on the stack.  In order for
                                       // SWITCH() to go to ThreadRoot when we switch to this thread, the
@@ -369,7 +503,7 @@ void Thread::StackAllocate(VoidFunctionPtr func, _int arg)
 #endif // HOST_SNAKE
 
     machineState[PCState] = (_int)ThreadRoot;
-    machineState[StartupPCState] = (_int)InterruptEnable;
+    machineState[StartupPCState] = (_int)ThreadBegin;
     machineState[InitialPCState] = (_int)func;
     machineState[InitialArgState] = arg;
     machineState[WhenDonePCState] = (_int)ThreadFinish;
@@ -450,7 +584,7 @@ void Thread::Terminated(){
     terminatedList->Append((void *)this);
     Thread *nextThread = scheduler->FindNextToRun();
     while(nextThread == NULL){
-        interrupt->Idle();
+        scheduler->Idle();
         nextThread = scheduler->FindNextToRun();
     }
     scheduler->Run(nextThread);
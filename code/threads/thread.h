@@ -24,7 +24,8 @@
 //	that your thread stacks are too small.)
 //
 //	One thing to try if you find yourself with seg faults is to
-//	increase the size of thread stack -- ThreadStackSize.
+//	increase the size of thread stack -- StackSize, or for just the
+//	one thread, the size passed when it is created.
 //
 //  	In this interface, forking a thread takes two steps.
 //	We must first allocate a data structure for it: "t = new Thread".
@@ -39,6 +40,7 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "interrupt.h"
 
 #ifdef USER_PROGRAM
 #include "machine.h"
@@ -50,13 +52,25 @@
 // For simplicity, this is just the max over all architectures.
 #define MachineStateSize 18
 
-// Size of the thread's private execution stack.
+// Size of the thread's private execution stack, unless it is created
+// with another.  Only the part of the stack that is used takes up host
+// memory, so it costs little to make this bigger.
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 #define StackSize (sizeof(_int) * 1024) // in words
+#define StackPoolSize 64 // # of stacks of finished threads kept for
+                         // new ones to use
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, TERMINATED };
 
+// Thread priorities, used by the scheduler's PriorityPolicy.  The
+// higher the number, the sooner the thread is run.
+#define NumPriorities 32  // priorities are 0 .. NumPriorities-1
+#define NormalPriority 16 // what a new thread gets
+#define IOPriority 24     // kernel threads that handle I/O, and threads
+                          // woken up when their I/O is done
+
+
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(_int arg);
 
@@ -80,7 +94,8 @@ private:
   _int machineState[MachineStateSize]; // all registers except for stackTop
 
 public:
-  Thread(char *debugName); // initialize a Thread
+  Thread(char *debugName,           // initialize a Thread,
+         int stackWords = StackSize); // with a stack of "stackWords"
   ~Thread();               // deallocate a Thread
                            // NOTE -- thread being deleted
                            // must not be running when delete
@@ -93,10 +108,48 @@ public:
   void Sleep();                              // Put the thread to sleep and relinquish the processor
   void Finish();                             // The thread is done executing
 
+  bool SetPeriodic(int newPeriod, int newBudget); // Make it a real-time
+                          // thread: every "newPeriod" ticks, it has a job
+                          // that may use "newBudget" ticks of CPU time, due
+                          // by the end of the period.  FALSE if it can't
+                          // be admitted (see Scheduler::AdmitPeriodic)
+  void WaitForPeriod();   // This period's job is done; wait for the next
+
   void CheckOverflow(); // Check if thread has overflowed its stack
   void setStatus(ThreadStatus st) { status = st; }
   char *getName() { return (name); }
   void Print() { printf("%s, ", name); }
+  int getTrack() { return track; } // its track in the -timeline
+  void setReadyTime(int when) { readyTime = when; }
+  int getReadyTime() { return readyTime; } // when it was last made ready
+  void setPriority(int p)
+  {
+    ASSERT(p >= 0 && p < NumPriorities);
+    priority = p;
+  }
+  int getPriority() { return priority; }
+
+  ThreadStatus getStatus() { return status; }
+
+  // for the Scheduler's own use
+  Thread *nextReady; // the next thread on the same run queue
+  int level;         // MLFQ: the queue it is in
+  int usedTicks;     // MLFQ: the CPU time it has had there
+  int epoch;         // MLFQ: the last reset of the queues it has seen
+  double vruntime;   // FairSharePolicy: the CPU time it has had,
+                     // scaled by NormalWeight / its weight
+  int cpu;           // the CPU it must run on, once it has run user
+                     // code there; -1 if any (see userprog/smp.h)
+
+  // real-time threads (see SetPeriodic); "period" is 0 for others
+  int period;        // how often it is given a job, in ticks
+  int budget;        // the CPU time each job may use
+  int deadline;      // when the current job is due (and the next begins)
+  int budgetLeft;    // the CPU time the current job may still use
+  bool jobDone;      // it is waiting for its next job
+  bool throttled;    // it has used up its budget, and is waiting too
+  bool late;         // it is still on a job that missed its deadline
+  IntHandle release; // the interrupt that starts the next job
 
 private:
   // some of the private data for this class is listed above
@@ -104,8 +157,12 @@ private:
   int *stack;          // Bottom of the stack
                        // NULL if this is the main thread
                        // (If NULL, don't deallocate stack)
+  int stackSize;       // and its size, in words
   ThreadStatus status; // ready, running or blocked
   char *name;
+  int track;           // where its events go, if there is a timeline
+  int readyTime;       // when it was put on the ready list
+  int priority;        // how urgently it should be run
 
   void StackAllocate(VoidFunctionPtr func, _int arg);
   // Allocate a stack for thread.
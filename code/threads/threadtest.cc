@@ -11,6 +11,7 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "synch.h"
 
 //----------------------------------------------------------------------
 // SimpleThread
@@ -51,3 +52,114 @@ ThreadTest()
     SimpleThread(0);
 }
 
+
+// MLFQTest: the state the spinning threads share.
+
+static Thread *lastSpinner;	// the spinner that ran last, and
+static bool lastAtBottom;	// whether it was at the bottom level
+static int bottomSwitches;	// # of times the CPU went from one
+				// spinner to another, both at the bottom
+static Semaphore *spinnersDone;
+
+//----------------------------------------------------------------------
+// Spinner
+// 	Use the CPU, without ever giving it up, for "ticks" ticks,
+//	noting each time it was taken over from the other spinner.
+//----------------------------------------------------------------------
+
+static void
+Spinner(_int ticks)
+{
+    int bottom = NumPriorities - MLFQLevels;
+    bool atBottom;
+
+    // each time interrupts go back on, the clock ticks
+    for (int i = 0; i < ticks / SystemTick; i++) {
+	interrupt->SetLevel(IntOff);
+	atBottom = (currentThread->level == bottom);
+	if (lastSpinner != currentThread && lastAtBottom && atBottom)
+	    bottomSwitches++;
+	lastSpinner = currentThread;
+	lastAtBottom = atBottom;
+	interrupt->SetLevel(IntOn);
+    }
+    spinnersDone->V();
+}
+
+//----------------------------------------------------------------------
+// MLFQTest
+// 	Check that CPU-bound threads at the MLFQ's bottom level are
+//	still time sliced: fork two that spin for 6000 ticks each, so
+//	that both soon use up the quanta above the bottom (700 ticks),
+//	and count how often they take turns there.  Run with -sched mlfq.
+//----------------------------------------------------------------------
+
+void
+MLFQTest()
+{
+    spinnersDone = new Semaphore("spinners done", 0);
+    for (int i = 0; i < 2; i++) {
+	Thread *t = new Thread("spinner");
+	t->Fork(Spinner, 6000);
+    }
+    for (int i = 0; i < 2; i++)
+	spinnersDone->P();
+    delete spinnersDone;
+
+    printf("MLFQ test: spinners took turns at the bottom level %d times\n",
+	   bottomSwitches);
+    ASSERT(bottomSwitches >= 3);
+}
+
+//----------------------------------------------------------------------
+// StackPoolTest
+// 	Check that the stacks of finished threads are kept, up to
+//	StackPoolSize of them, and used again: fork and finish several
+//	rounds of more threads than the pool holds at once.  After the
+//	first round, each round should get StackPoolSize stacks from the
+//	pool, and make (and later unmap) only the rest.
+//----------------------------------------------------------------------
+
+#define StackTestThreads (StackPoolSize + 16)
+#define StackTestRounds 10
+
+static Semaphore *stackTestDone;
+
+static void
+StackTestThread(_int which)
+{
+    stackTestDone->V();
+}
+
+void
+StackPoolTest()
+{
+    int made = stats->numStacksMade, reused = stats->numStacksReused;
+    int unmapped = stats->numStacksUnmapped;
+    int pooled;
+
+    stackTestDone = new Semaphore("stack test done", 0);
+    for (int round = 0; round < StackTestRounds; round++) {
+	for (int i = 0; i < StackTestThreads; i++) {
+	    Thread *t = new Thread("stack test");
+	    t->Fork(StackTestThread, i);
+	}
+	for (int i = 0; i < StackTestThreads; i++)
+	    stackTestDone->P();
+	// they are all deleted now, so their stacks are pooled or unmapped
+
+	pooled = stats->numStacksMade - stats->numStacksUnmapped;
+	ASSERT(pooled <= StackPoolSize);
+    }
+    delete stackTestDone;
+
+    made = stats->numStacksMade - made;
+    reused = stats->numStacksReused - reused;
+    unmapped = stats->numStacksUnmapped - unmapped;
+    printf("Stack pool test: %d threads, %d stacks made, %d reused, "
+	   "%d unmapped\n", StackTestThreads * StackTestRounds, made,
+	   reused, unmapped);
+    ASSERT(reused >= (StackTestRounds - 1) * StackPoolSize);
+    ASSERT(made <= StackTestThreads + (StackTestRounds - 1) *
+	   (StackTestThreads - StackPoolSize));
+}
@@ -0,0 +1,282 @@
+// timeline.cc
+//	Routines to record a timeline of kernel activity, in the Chrome
+//	trace-event format.  See timeline.h.
+//
+//	Every event is written as soon as it is complete, so the events
+//	come out roughly, but not exactly, in time order; the viewers
+//	sort them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "timeline.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Timeline::Timeline
+// 	Create the trace file, and label the device tracks.  Call this
+//	before any thread is created: the first thread is the one Nachos
+//	starts out in ("main"), which is on the CPU.
+//
+//	"fileName" -- the UNIX file to write the trace to
+//----------------------------------------------------------------------
+
+Timeline::Timeline(char *fileName)
+{
+    if ((file = fopen(fileName, "w")) == NULL)
+    {
+        perror(fileName);
+        ASSERT(FALSE);
+    }
+    fprintf(file, "[\n");
+    numEvents = 0;
+    hostZero = HostSeconds();
+
+    maxTracks = 16;
+    names = new char *[maxTracks];
+    numTracks = 0;
+    running = -1;
+    sliceStart = stats->totalTicks;
+    hostSlice = hostZero;
+
+    NameTrack(CPUTrack, "cpu");
+    NameTrack(InterruptTrack, "interrupts");
+    NameTrack(DiskTrack, "disk");
+}
+
+//----------------------------------------------------------------------
+// Timeline::~Timeline
+// 	Record what is on the CPU now, end the trace, and close it.
+//----------------------------------------------------------------------
+
+Timeline::~Timeline()
+{
+    EndSlice(stats->totalTicks);
+    fprintf(file, "\n]\n");
+    fclose(file);
+    for (int i = 0; i < numTracks; i++)
+        delete[] names[i];
+    delete[] names;
+}
+
+//----------------------------------------------------------------------
+// Timeline::NewThread
+// 	Give a new thread its own track, labelled with its name.
+//
+//	"name" -- the thread's name, which is copied, since the thread
+//		may outlive it
+//----------------------------------------------------------------------
+
+int Timeline::NewThread(const char *name)
+{
+    int track = numTracks;
+
+    NameTrack(track, name);
+    Begin("created", 'i', track, stats->totalTicks);
+    End(HostSeconds(), -1);
+    if (running == -1)
+        running = track; // the thread we started in
+    return track;
+}
+
+//----------------------------------------------------------------------
+// Timeline::ThreadFinished
+// 	Mark the end of a thread's life on its track.
+//----------------------------------------------------------------------
+
+void Timeline::ThreadFinished(int track)
+{
+    Begin("finished", 'i', track, stats->totalTicks);
+    End(HostSeconds(), -1);
+}
+
+//----------------------------------------------------------------------
+// Timeline::Switch
+// 	Record that the thread running until now had the CPU since its
+//	slice began, and start a slice for the thread on "track".
+//	Called by Scheduler::Run, for every context switch.
+//----------------------------------------------------------------------
+
+void Timeline::Switch(int track)
+{
+    EndSlice(stats->totalTicks);
+    running = track;
+    sliceStart = stats->totalTicks;
+    hostSlice = HostSeconds();
+}
+
+//----------------------------------------------------------------------
+// Timeline::Idle
+// 	Record that the machine had nothing to do from tick "from" to
+//	"to", when the next interrupt was due.  The thread that idles
+//	stays on the CPU, so its slice goes on at "to".
+//----------------------------------------------------------------------
+
+void Timeline::Idle(int from, int to)
+{
+    double now = HostSeconds();
+
+    EndSlice(from);
+    Begin("idle", 'X', CPUTrack, from);
+    End(now, to - from);
+    sliceStart = to;
+    hostSlice = now;
+}
+
+//----------------------------------------------------------------------
+// Timeline::InterruptHandled
+// 	Record a call of an interrupt handler, just returned.  Handlers
+//	run with interrupts off, so take no simulated time; the host time
+//	they took is noted.
+//
+//	"device" -- the kind of interrupt
+//	"due" -- when it was scheduled for (it may be handled later, if
+//		interrupts were off)
+//	"hostStart" -- host time when the handler was called
+//----------------------------------------------------------------------
+
+void Timeline::InterruptHandled(const char *device, int due, double hostStart)
+{
+    Begin(device, 'X', InterruptTrack, stats->totalTicks);
+    fprintf(file, "\"due\":%d,", due);
+    End(hostStart, 0);
+}
+
+//----------------------------------------------------------------------
+// Timeline::DiskRequest
+// 	Record a disk request, just started.  The disk knows how long it
+//	will take, so it is recorded all at once.
+//----------------------------------------------------------------------
+
+void Timeline::DiskRequest(int sector, bool writing, int latency)
+{
+    Begin(writing ? "write" : "read", 'X', DiskTrack, stats->totalTicks);
+    fprintf(file, "\"sector\":%d,", sector);
+    End(HostSeconds(), latency);
+}
+
+//----------------------------------------------------------------------
+// Timeline::SystemCall
+// 	Record a system call made by the thread on "track", which has
+//	just returned.  It lasted from tick "start", including any time
+//	the thread spent blocked in it.
+//----------------------------------------------------------------------
+
+void Timeline::SystemCall(int track, const char *name, int start, double hostStart)
+{
+    Begin(name, 'X', track, start);
+    End(hostStart, stats->totalTicks - start);
+}
+
+//----------------------------------------------------------------------
+// Timeline::LockWait
+// 	Record that the thread on "track" waited for a lock, from tick
+//	"start" until now, when it got it.
+//----------------------------------------------------------------------
+
+void Timeline::LockWait(int track, const char *lockName, int start, double hostStart)
+{
+    Begin("lock wait", 'X', track, start);
+    fprintf(file, "\"lock\":");
+    PutString(lockName);
+    fprintf(file, ",");
+    End(hostStart, stats->totalTicks - start);
+}
+
+//----------------------------------------------------------------------
+// Timeline::EndSlice
+// 	If a thread has been on the CPU, record its slice, from when it
+//	began until tick "until".  Empty slices are left out.
+//----------------------------------------------------------------------
+
+void Timeline::EndSlice(int until)
+{
+    if (running == -1 || until <= sliceStart)
+        return;
+    Begin(names[running], 'X', CPUTrack, sliceStart);
+    End(hostSlice, until - sliceStart);
+}
+
+//----------------------------------------------------------------------
+// Timeline::NameTrack
+// 	Label "track" with "name", and keep the name, for the CPU's slices.
+//	Tracks are numbered in order, from 0.
+//----------------------------------------------------------------------
+
+void Timeline::NameTrack(int track, const char *name)
+{
+    ASSERT(track == numTracks);
+    if (numTracks == maxTracks)
+    { // out of room; double it
+        char **bigger = new char *[2 * maxTracks];
+
+        for (int i = 0; i < numTracks; i++)
+            bigger[i] = names[i];
+        delete[] names;
+        names = bigger;
+        maxTracks *= 2;
+    }
+    names[numTracks] = new char[strlen(name) + 1];
+    strcpy(names[numTracks], name);
+    numTracks++;
+
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"tid\":%d,\"args\":{\"name\":",
+            numEvents++ ? ",\n" : "", track);
+    PutString(name);
+    fprintf(file, "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+                  "\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+            track, track);
+}
+
+//----------------------------------------------------------------------
+// Timeline::Begin, Timeline::End
+// 	Write an event, in two halves, so the caller can add arguments
+//	in between (each followed by a comma).
+//
+//	"name" -- what happened
+//	"phase" -- 'X' for something that lasts, 'i' for an instant
+//	"track" -- which track it is shown on
+//	"when" -- the tick it started at
+//----------------------------------------------------------------------
+
+void Timeline::Begin(const char *name, char phase, int track, int when)
+{
+    fprintf(file, "%s{\"name\":", numEvents++ ? ",\n" : "");
+    PutString(name);
+    fprintf(file, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%d,\"args\":{",
+            phase, track, when);
+}
+
+void Timeline::End(double hostStart, int duration)
+{
+    fprintf(file, "\"host_us\":%.0f", (hostStart - hostZero) * 1e6);
+    if (duration >= 0)
+        fprintf(file, ",\"host_dur_us\":%.0f},\"dur\":%d}",
+                (HostSeconds() - hostStart) * 1e6, duration);
+    else
+        fprintf(file, "},\"s\":\"t\"}");
+}
+
+//----------------------------------------------------------------------
+// Timeline::PutString
+// 	Write "s" in double quotes, escaping anything JSON doesn't allow
+//	in a string as is.
+//----------------------------------------------------------------------
+
+void Timeline::PutString(const char *s)
+{
+    putc('"', file);
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(file, "\\%c", *s);
+        else if ((unsigned char)*s < ' ')
+            fprintf(file, "\\u%04x", *s);
+        else
+            putc(*s, file);
+    }
+    putc('"', file);
+}
@@ -0,0 +1,84 @@
+// timeline.h
+//	Data structures for recording what the kernel does over time, as
+//	a Chrome trace-event file (JSON), which chrome://tracing and
+//	Perfetto (ui.perfetto.dev) show as a timeline -- rather than
+//	printing it as it happens, as with -d.
+//
+//	Time stamps are in simulated ticks (shown as microseconds).  Each
+//	event also records the host time at which it happened, as the
+//	argument "host_us" (microseconds since the timeline was started),
+//	so that the cost of simulating each part can be seen as well.
+//
+//	The timeline has a track for the CPU, showing which thread ran
+//	when (and when the machine was idle); one for interrupt handlers;
+//	one for the disk, showing each request for as long as the disk
+//	takes to do it; and one for each Nachos thread, showing when it
+//	was created and finished, its system calls, and its waits for
+//	locks.
+//
+//	The events are written as a JSON array.  The closing "]" is
+//	optional, so a trace cut short by a crash can still be read.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The tracks that aren't threads; each thread gets the next one free.
+
+enum TimelineTrack { CPUTrack, InterruptTrack, DiskTrack, NumDeviceTracks };
+
+// The following class defines a timeline being written to a UNIX file.
+
+class Timeline
+{
+public:
+  Timeline(char *fileName); // Create the trace file
+  ~Timeline();              // Finish the trace, and close it
+
+  int NewThread(const char *name); // a thread was created; returns its track
+  void ThreadFinished(int track); // the thread on "track" is done
+  void Switch(int track);         // the CPU switches to the thread
+                                  // on "track"
+  void Idle(int from, int to);    // the CPU is idle from tick "from"
+                                  // until "to"
+
+  void InterruptHandled(const char *device, int due, double hostStart);
+  // a "device" interrupt, due at tick "due", was
+  // handled (starting at host time "hostStart")
+  void DiskRequest(int sector, bool writing, int latency);
+  // the disk starts a request, for "latency" ticks
+  void SystemCall(int track, const char *name, int start, double hostStart);
+  // the thread on "track" made system call
+  // "name" at tick "start", and it just returned
+  void LockWait(int track, const char *lockName, int start, double hostStart);
+  // the thread on "track" waited from tick "start"
+  // until now for lock "lockName"
+
+private:
+  void NameTrack(int track, const char *name); // label a track
+  void Begin(const char *name, char phase, int track, int when);
+  // start writing an event, up to its arguments
+  void End(double hostStart, int duration);
+  // and finish it: it took "duration" ticks (or
+  // is an instant, if < 0), from host time "hostStart"
+  void EndSlice(int until); // record the CPU's last slice, if any
+  void PutString(const char *s); // write "s" as a JSON string
+
+  FILE *file;       // the trace being written
+  int numEvents;    // # of events written so far
+  double hostZero;  // host time when the timeline began
+  char **names;     // the name of each track
+  int numTracks;    // tracks handed out so far
+  int maxTracks;    // size of "names"
+  int running;      // the track of the thread on the CPU, or -1
+  int sliceStart;   // when it got the CPU (or the machine woke up)
+  double hostSlice; // the host time then
+};
+
+#endif // TIMELINE_H
@@ -26,7 +26,8 @@ extern Machine *machine;
 
 #define MAX_USERPROCESS 256 // 最多256个进程
 // 静态类成员只初始化一次，在方法文件中初始化
-BitMap *AddrSpace::PageBitmap = new BitMap(NumPhysPages);
+// (PageBitmap要等机器大小确定后，在第一个地址空间创建时分配)
+BitMap *AddrSpace::PageBitmap = NULL;
 BitMap *AddrSpace::PidMap = new BitMap(MAX_USERPROCESS);
 
 //----------------------------------------------------------------------
@@ -60,12 +61,23 @@ static void SwapHeader(NoffHeader *noffH)
 //	First, set up the translation from program memory to physical
 //	memory.  For now, this is really simple (1:1), since we are
 //	only uniprogramming, and we have a single unsegmented page table
+//	(or a two-level or inverted one, if "tableKind" says so)
 //
 //	"executable" is the file containing the object code to load into memory
+//	"tableKind" is the kind of page table to use
 //----------------------------------------------------------------------
 
-AddrSpace::AddrSpace(OpenFile *executable)
+AddrSpace::AddrSpace(OpenFile *executable, PageTableKind tableKind)
 {
+    profile = NULL; // until StartProfile
+    group = NULL;   // until JoinGroup
+    kind = tableKind;
+    pageTable = NULL;
+    directory = NULL;
+    numPages = 0;
+    if (PageBitmap == NULL)
+        PageBitmap = new BitMap(numPhysPages);
+
     // 分配进程号pid
     spaceId = PidMap->Find() + 100; // 0-100是核心，100-256是用户进程
     // 不存在则返回-1
@@ -90,10 +102,10 @@ AddrSpace::AddrSpace(OpenFile *executable)
     // how big is address space?
     size = noffH.code.size + noffH.initData.size + noffH.uninitData.size + UserStackSize; // we need to increase the size
                                                                                           // to leave room for the stack
-    numPages = divRoundUp(size, PageSize);
-    size = numPages * PageSize;
+    numPages = divRoundUp(size, pageSize);
+    size = numPages * pageSize;
 
-    ASSERT(numPages <= NumPhysPages); // check we're not trying
+    ASSERT(numPages <= (unsigned)numPhysPages); // check we're not trying
                                       // to run anything too big --
                                       // at least until we have
                                       // virtual memory
@@ -101,19 +113,18 @@ AddrSpace::AddrSpace(OpenFile *executable)
     DEBUG('a', "Initializing address space, num pages %d, size %d\n",
           numPages, size);
     // first, set up the translation
-    pageTable = new TranslationEntry[numPages];
+    CreateTable();
     for (i = 0; i < numPages; i++)
     {
-        pageTable[i].virtualPage = i;                   // for now, virtual page # = phys page #
-        pageTable[i].physicalPage = PageBitmap->Find(); // 找到空闲页
-        pageTable[i].valid = TRUE;
-        pageTable[i].use = FALSE;
-        pageTable[i].dirty = FALSE;
-        pageTable[i].readOnly = FALSE; // if the code segment was entirely on
-                                       // a separate page, we could set its
-                                       // pages to be read-only
+        TranslationEntry *entry = MapPage(i, PageBitmap->Find()); // 找到空闲页
+
+        entry->readOnly = FALSE; // if the code segment was entirely on
+                                 // a separate page, we could set its
+                                 // pages to be read-only
         // 清理每一页的数据内存空间
-        bzero(&(machine->mainMemory[pageTable[i].physicalPage * PageSize]), PageSize);
+        bzero(&(machine->mainMemory[entry->physicalPage * pageSize]), pageSize);
+        // 页面内容将被改写，丢弃各 CPU 在该帧上缓存的预解码指令
+        InvalidateCode(entry->physicalPage);
     }
 
     // zero out the entire address space, to zero the unitialized data segment
@@ -126,8 +137,8 @@ AddrSpace::AddrSpace(OpenFile *executable)
         DEBUG('a', "Initializing code segment, at 0x%x, size %d\n",
               noffH.code.virtualAddr, noffH.code.size);
         // 通过虚拟地址，将程序写入内存对应物理地址
-        int phyaddr = pageTable[noffH.code.virtualAddr / PageSize].physicalPage * PageSize;
-        int offset = noffH.code.virtualAddr % PageSize;
+        int phyaddr = PageEntry(noffH.code.virtualAddr / pageSize)->physicalPage * pageSize;
+        int offset = noffH.code.virtualAddr % pageSize;
         executable->ReadAt(&(machine->mainMemory[phyaddr + offset]),
                            noffH.code.size, noffH.code.inFileAddr);
     }
@@ -135,9 +146,9 @@ AddrSpace::AddrSpace(OpenFile *executable)
     {
         DEBUG('a', "Initializing data segment, at 0x%x, size %d\n",
               noffH.initData.virtualAddr, noffH.initData.size);
-        int phyaddr = pageTable[noffH.initData.virtualAddr / PageSize].physicalPage * PageSize;
+        int phyaddr = PageEntry(noffH.initData.virtualAddr / pageSize)->physicalPage * pageSize;
         ;
-        int offset = noffH.initData.virtualAddr % PageSize;
+        int offset = noffH.initData.virtualAddr % pageSize;
         executable->ReadAt(&(machine->mainMemory[phyaddr + offset]),
                            noffH.initData.size, noffH.initData.inFileAddr);
     }
@@ -145,7 +156,59 @@ AddrSpace::AddrSpace(OpenFile *executable)
 
 
 
+//----------------------------------------------------------------------
+// AddrSpace::AddrSpace
+// 	Re-create an address space from a checkpoint (see Checkpoint).
+//	The contents of its pages come back with the rest of main memory
+//	(Machine::Restore), in the same physical pages, so here we just
+//	claim those pages and the SpaceId again.
+//
+//	"checkpoint" is the open UNIX file to read it from
+//----------------------------------------------------------------------
+
+AddrSpace::AddrSpace(int checkpoint)
+{
+    profile = NULL; // until StartProfile
+    group = NULL;
+    if (PageBitmap == NULL)
+        PageBitmap = new BitMap(numPhysPages);
 
+    Read(checkpoint, (char *)&spaceId, sizeof(int));
+    ASSERT(!PidMap->Test(spaceId - 100));
+    PidMap->Mark(spaceId - 100);
+
+    Read(checkpoint, (char *)&kind, sizeof(PageTableKind));
+    Read(checkpoint, (char *)&numPages, sizeof(int));
+    ASSERT(numPages <= (unsigned)numPhysPages);
+    pageTable = NULL;
+    directory = NULL;
+    CreateTable();
+    for (unsigned int i = 0; i < numPages; i++)
+    {
+        TranslationEntry saved;
+
+        Read(checkpoint, (char *)&saved, sizeof(TranslationEntry));
+        ASSERT(!PageBitmap->Test(saved.physicalPage)); // 该帧已被占用
+        PageBitmap->Mark(saved.physicalPage);
+        *MapPage(i, saved.physicalPage) = saved; // with its use, dirty bits
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Checkpoint
+// 	Write what we need to re-create this address space -- its SpaceId
+//	and page table -- to the open UNIX file "fd".  Whatever the kind
+//	of page table, its entries are written in virtual page order.
+//----------------------------------------------------------------------
+
+void AddrSpace::Checkpoint(int fd)
+{
+    WriteFile(fd, (char *)&spaceId, sizeof(int));
+    WriteFile(fd, (char *)&kind, sizeof(PageTableKind));
+    WriteFile(fd, (char *)&numPages, sizeof(int));
+    for (unsigned int i = 0; i < numPages; i++)
+        WriteFile(fd, (char *)PageEntry(i), sizeof(TranslationEntry));
+}
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
@@ -156,9 +219,40 @@ AddrSpace::~AddrSpace()
     // 一个程序结束后，回收内存
     for (int i = 0; i < numPages; i++)
     {
-        PageBitmap->Clear(pageTable[i].physicalPage);
+        int frame = PageEntry(i)->physicalPage;
+
+        PageBitmap->Clear(frame);
+        if (kind == InvertedTable)
+            machine->invertedTable->Unmap(frame);
     }
     delete[] pageTable;
+    delete directory;
+#ifdef USE_TLB
+    FlushSpaceTLB(spaceId); // its translations are no longer valid
+#endif
+    if (group != NULL && --group->members == 0)
+        delete group;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::JoinGroup
+// 	Share the CPU with the address space "parent" (and whoever else
+//	shares it with), under the fair-share scheduler: a process made
+//	by Exec joins the group of the one that made it.  If "parent" is
+//	in no group yet, it starts one, with the weight of a single
+//	thread.
+//----------------------------------------------------------------------
+
+void AddrSpace::JoinGroup(AddrSpace *parent)
+{
+    ASSERT(group == NULL);
+    if (parent->group == NULL)
+    {
+        parent->group = new SchedGroup;
+        parent->group->members = 1;
+    }
+    group = parent->group;
+    group->members++;
 }
 
 //----------------------------------------------------------------------
@@ -188,8 +282,8 @@ void AddrSpace::InitRegisters()
     // Set the stack register to the end of the address space, where we
     // allocated the stack; but subtract off a bit, to make sure we don't
     // accidentally reference off the end!
-    machine->WriteRegister(StackReg, numPages * PageSize - 16);
-    DEBUG('a', "Initializing stack register to %d\n", numPages * PageSize - 16);
+    machine->WriteRegister(StackReg, numPages * pageSize - 16);
+    DEBUG('a', "Initializing stack register to %d\n", numPages * pageSize - 16);
 }
 
 //----------------------------------------------------------------------
@@ -209,13 +303,125 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      For now, tell the machine where to find the page table, and
+//	which address space the TLB or inverted page table entries are
+//	for.  (With a TLB, the page table is for RefillTLB.)
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState()
 {
+#ifndef USE_TLB
+    machine->tableKind = kind;
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
+    machine->pageDirectory = directory;
+#endif
+    machine->SetASID(spaceId); // cached translations were for the old space
+    if (profiler != NULL)
+        profiler->Switch(profile);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RefillTLB
+// 	Handle a TLB miss (PageFaultException) at "virtAddr", by loading
+//	its translation from the page table into the TLB.  Returns FALSE
+//	if the address isn't in this address space at all.
+//----------------------------------------------------------------------
+
+bool AddrSpace::RefillTLB(int virtAddr)
+{
+    unsigned int vpn = (unsigned)virtAddr >> pageShift;
+    TranslationEntry *entry = PageEntry(vpn);
+
+    if (entry == NULL || !entry->valid)
+        return FALSE;
+    DEBUG('a', "TLB miss at 0x%x, loading page %d\n", virtAddr, vpn);
+    machine->LoadTLB(entry);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CreateTable
+// 	Make an empty page table of our kind, for numPages virtual pages.
+//	Only a linear one is allocated in full; the inverted page table
+//	belongs to the machine, and is made when first needed.
+//----------------------------------------------------------------------
+
+void AddrSpace::CreateTable()
+{
+    switch (kind)
+    {
+    case LinearTable:
+        pageTable = new TranslationEntry[numPages];
+        for (unsigned int i = 0; i < numPages; i++)
+            pageTable[i].valid = FALSE;
+        break;
+    case TwoLevelTable:
+        directory = new PageDirectory(numPages);
+        break;
+    case InvertedTable:
+        if (machine->invertedTable == NULL)
+            machine->invertedTable = new InvertedPageTable(numPhysPages);
+        break;
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MapPage
+// 	Map virtual page "vpn" to physical page "frame", in whatever kind
+//	of page table we have, and return the (valid, writable) entry.
+//----------------------------------------------------------------------
+
+TranslationEntry *AddrSpace::MapPage(unsigned int vpn, int frame)
+{
+    TranslationEntry *entry;
+
+    if (kind == InvertedTable)
+        return machine->invertedTable->Map(spaceId, vpn, frame);
+    entry = (kind == LinearTable) ? &pageTable[vpn] : directory->Map(vpn);
+    entry->virtualPage = vpn;
+    entry->physicalPage = frame;
+    entry->valid = TRUE;
+    entry->readOnly = FALSE;
+    entry->use = FALSE;
+    entry->dirty = FALSE;
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageEntry
+// 	Return the page table entry for virtual page "vpn", or NULL if
+//	it is outside the address space.
+//----------------------------------------------------------------------
+
+TranslationEntry *AddrSpace::PageEntry(unsigned int vpn)
+{
+    if (vpn >= numPages)
+        return NULL;
+    switch (kind)
+    {
+    case LinearTable:
+        return &pageTable[vpn];
+    case TwoLevelTable:
+        return directory->Lookup(vpn);
+    default:
+        return machine->invertedTable->Lookup(spaceId, vpn);
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::StartProfile
+// 	If we are profiling (-profile), start counting the instructions
+//	executed in this address space.
+//
+//	"fileName" is the executable it was loaded from, whose symbols
+//	will be used in the report
+//----------------------------------------------------------------------
+
+void AddrSpace::StartProfile(char *fileName)
+{
+    if (profiler != NULL)
+        profile = profiler->NewSpace(spaceId, fileName, numPages * pageSize);
 }
 
 // 输出程序页表（页面与帧的映射关系）
@@ -227,7 +433,7 @@ void AddrSpace::Print()
 
     for (int i = 0; i < numPages; i++)
     {
-        printf("\t %d, \t\t%d\n", pageTable[i].virtualPage, pageTable[i].physicalPage);
+        printf("\t %d, \t\t%d\n", PageEntry(i)->virtualPage, PageEntry(i)->physicalPage);
     }
     printf("============================================\n\n");
 }
\ No newline at end of file
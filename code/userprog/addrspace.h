@@ -15,15 +15,21 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "profile.h"
+
+class SchedGroup; // see scheduler.h
 
 #define UserStackSize 1024 // increase this as necessary!
 
 class AddrSpace
 {
 public:
-  AddrSpace(OpenFile *executable); // Create an address space,
+  AddrSpace(OpenFile *executable,   // Create an address space,
+            PageTableKind tableKind = pageTableKind);
                                    // initializing it with the program
                                    // stored in the file "executable"
+  AddrSpace(int checkpoint);       // Re-create the address space saved
+                                   // in an open checkpoint file
   ~AddrSpace();                    // De-allocate an address space
 
   void InitRegisters(); // Initialize user-level CPU registers,
@@ -32,15 +38,30 @@ public:
   void SaveState();    // Save/restore address space-specific
   void RestoreState(); // info on a context switch
 
+  void Checkpoint(int fd); // Save the page table to a UNIX file
+
+  bool RefillTLB(int virtAddr); // Load the translation of "virtAddr"
+                                // into the TLB; FALSE if unmapped
+
+  void StartProfile(char *fileName); // Count this space's instructions,
+                                     // if profiling; "fileName" is the
+                                     // executable it was loaded from
+
   // 输出程序页表（页面与帧的映射关系）
   void Print();
   int getSpaceId(){return spaceId;}
 
+  void JoinGroup(AddrSpace *parent); // Share the CPU with "parent"
+  SchedGroup *group; // who it shares the CPU with, under the
+                     // fair-share scheduler; NULL if no one
+
 
 
 private:
-  // Assume linear page table translation for now!
-  TranslationEntry *pageTable; 
+  PageTableKind kind;          // which of these we translate with:
+  TranslationEntry *pageTable; // a linear page table, or
+  PageDirectory *directory;    // a two-level one (or, for an inverted
+                               // page table, neither)
 
   // Number of pages in the virtual address space
   unsigned int numPages;       
@@ -51,6 +72,14 @@ private:
 
   // spaceID当作PID
   int spaceId;
+
+  SpaceProfile *profile; // execution counts, NULL if not profiled
+
+  void CreateTable();     // Allocate an empty page table of our kind
+  TranslationEntry *MapPage(unsigned int vpn, int frame);
+                          // Map "vpn" to physical page "frame"
+  TranslationEntry *PageEntry(unsigned int vpn);
+                          // Find the entry for "vpn", if any
                                
                       
 };
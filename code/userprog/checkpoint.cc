@@ -0,0 +1,135 @@
+// checkpoint.cc
+//	Routines to save a running user program to a UNIX file, and to
+//	start a later Nachos from that point (-checkpoint and -restore),
+//	skipping everything it took to get there.
+//
+//	A checkpoint holds what the user program can see, and what the
+//	kernel needs to carry on running it:
+//		its address space (SpaceId and page table)
+//		the registers, all of main memory and the TLB
+//		the statistics, including the simulated time
+//		when each pending interrupt is due
+//
+//	Only a single user program can be saved.  Kernel threads run on
+//	host stacks, which can't be written out and read back into another
+//	Nachos, so the checkpoint is taken only when the program is between
+//	two user instructions, and no other thread is ready or waiting.
+//	For the same reason, pending interrupts are matched up with the
+//	devices of the restored run by kind (see Interrupt::Restore).
+//
+//	The random number generator isn't saved, so with -rs the time
+//	slices after a restore are not those of the original run.  The
+//	file is in host byte order, and can only be read by a Nachos with
+//	the same machine geometry (-mem, -pagesize, -tlbsize).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "addrspace.h"
+
+#define CheckpointMagic 0x4e434b50 // first word of every checkpoint
+
+//----------------------------------------------------------------------
+// WriteCheckpoint
+// 	Save the running user program to the UNIX file "fileName".
+//	Called from an interrupt handler, with the program stopped between
+//	two instructions; the program then carries on as if nothing had
+//	happened.
+//----------------------------------------------------------------------
+
+static void WriteCheckpoint(char *fileName)
+{
+    int fd;
+    int header[4] = {CheckpointMagic, numPhysPages, pageSize,
+                     (machine->tlb != NULL) ? tlbSize : 0};
+
+    if (!scheduler->IsEmpty() ||
+        !scheduler->getWaitingList()->IsEmpty())
+    {
+        printf("Unable to checkpoint: only one thread can be saved\n");
+        return;
+    }
+    fd = OpenForWrite(fileName);
+    WriteFile(fd, (char *)header, sizeof(header));
+    currentThread->space->Checkpoint(fd);
+    machine->Checkpoint(fd);
+    stats->Checkpoint(fd);
+    interrupt->Checkpoint(fd);
+    Close(fd);
+    printf("Checkpoint written to %s at time %d\n", fileName,
+           stats->totalTicks);
+}
+
+//----------------------------------------------------------------------
+// CheckpointHandler
+// 	Interrupt handler for taking a checkpoint.  If the user program
+//	wasn't running when the time came (we were in the kernel, or
+//	idle), try again on the next tick.
+//
+//	"arg" is the name of the UNIX file to write
+//----------------------------------------------------------------------
+
+static void CheckpointHandler(_int arg)
+{
+    if (interrupt->getInterruptedStatus() != UserMode)
+        interrupt->Schedule(CheckpointHandler, arg, UserTick, TimerInt);
+    else
+        WriteCheckpoint((char *)arg);
+}
+
+//----------------------------------------------------------------------
+// ScheduleCheckpoint
+// 	Arrange for the running user program to be saved to the UNIX file
+//	"fileName" once the simulated time reaches "when".
+//----------------------------------------------------------------------
+
+void ScheduleCheckpoint(char *fileName, int when)
+{
+    ASSERT(when > stats->totalTicks);
+    interrupt->Schedule(CheckpointHandler, (_int)fileName,
+                        when - stats->totalTicks, TimerInt);
+}
+
+//----------------------------------------------------------------------
+// RestoreProcess
+// 	Run the user program saved in the checkpoint "fileName", from
+//	where it was saved.  Like StartProcess, this never returns.
+//----------------------------------------------------------------------
+
+void RestoreProcess(char *fileName)
+{
+    int fd = OpenForReadWrite(fileName, FALSE);
+    int header[4];
+    AddrSpace *space;
+
+    if (fd < 0)
+    {
+        printf("Unable to open checkpoint %s\n", fileName);
+        return;
+    }
+    Read(fd, (char *)header, sizeof(header));
+    ASSERT(header[0] == CheckpointMagic);            // not a checkpoint
+    if (header[1] != numPhysPages || header[2] != pageSize ||
+        header[3] != ((machine->tlb != NULL) ? tlbSize : 0))
+    {
+        printf("Checkpoint %s is of a machine with %d pages of %d bytes "
+               "and %d TLB entries\n", fileName, header[1], header[2],
+               header[3]);
+        Close(fd);
+        return;
+    }
+
+    space = new AddrSpace(fd);
+    currentThread->space = space;
+    machine->Restore(fd);  // registers and memory
+    stats->Restore(fd);    // the time, before any interrupt
+    interrupt->Restore(fd);
+    Close(fd);
+
+    space->RestoreState(); // load page table register
+    machine->Run();        // carry on where we left off
+    ASSERT(FALSE);         // machine->Run never returns
+}
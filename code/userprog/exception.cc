@@ -30,6 +30,7 @@
 #include "openfile.h"
 #include "filesys.h"
 #include "addrspace.h"
+#include "usermem.h"
 extern Machine *machine;
 extern FileSystem *fileSystem;
 
@@ -58,8 +59,8 @@ void StartProcess(int spaceId)
 
 
 //----------------------------------------------------------------------
-// ExceptionHandler
-// 	Entry point into the Nachos kernel.  Called when a user program
+// HandleException
+// 	Handle a trap into the Nachos kernel.  Called when a user program
 //	is executing, and either does a syscall, or generates an addressing
 //	or arithmetic exception.
 //
@@ -80,7 +81,7 @@ void StartProcess(int spaceId)
 //	are in machine.h.
 //----------------------------------------------------------------------
 // which指的是中断类型（内中断）
-void ExceptionHandler(ExceptionType which)
+static void HandleException(ExceptionType which)
 {
     // 系统调用号保存在MIPS的2号寄存器中
     int type = machine->ReadRegister(2);
@@ -101,14 +102,15 @@ void ExceptionHandler(ExceptionType which)
             printf("CurrentThreadID: %d Name: %s \n", currentThread->space->getSpaceId(), currentThread->getName());
             // 1.读取参数
             char filename[128];
-            // 寄存器存放的是字符串的首字符地址
+            // 寄存器存放的是字符串的首字符地址，从用户内存读取文件名
             int addr = machine->ReadRegister(4);
-            int i = 0;
-            do
+            if (StringFromUser(addr, filename, sizeof(filename)) < 0)
             {
-                // 从内存读取文件名
-                machine->ReadMem(addr + i, 1, (int *)&filename[i]);
-            } while (filename[i++] != '\0');
+                printf("Bad file name at 0x%x\n", addr);
+                machine->WriteRegister(2, -1);
+                AdvancePC();
+                break;
+            }
 
             printf("Exec(%s):\n", filename);
             // 2.打开可执行文件
@@ -120,6 +122,8 @@ void ExceptionHandler(ExceptionType which)
 
             // 3.为执行文件创建执行地址空间
             AddrSpace *space = new AddrSpace(executable);
+            space->StartProfile(filename);
+            space->JoinGroup(currentThread->space); // 子进程与父进程共享CPU份额
             space->Print();
             delete executable;
 
@@ -184,6 +188,13 @@ void ExceptionHandler(ExceptionType which)
 
         }
     }
+    else if (which == PageFaultException && machine->tlb != NULL &&
+             currentThread->space->RefillTLB(
+                 machine->ReadRegister(BadVAddrReg)))
+    {
+        // a TLB miss: the page is mapped, so retry the instruction
+        // (the PC hasn't moved) now that its translation is loaded
+    }
     else
     {
         printf("Unexpected user mode exception %d %d\n", which, type);
@@ -191,3 +202,34 @@ void ExceptionHandler(ExceptionType which)
     }
 }
 
+// The names of the system calls, by code (see syscall.h)
+static const char *syscallNames[] = {"Halt", "Exit", "Exec", "Join",
+                                     "Create", "Open", "Read", "Write",
+                                     "Close", "Fork", "Yield"};
+
+//----------------------------------------------------------------------
+// ExceptionHandler
+// 	Entry point into the Nachos kernel, from Machine::RaiseException.
+//	Each system call is timed, for as long as it takes (including any
+//	time the thread is blocked in it), and if there is a -timeline,
+//	recorded on the calling thread's track.  Exit and Halt don't
+//	return, so they show up as the end of the thread, or the trace.
+//----------------------------------------------------------------------
+
+void ExceptionHandler(ExceptionType which)
+{
+    int type = machine->ReadRegister(2);
+    int start = stats->totalTicks;
+    double hostStart = (timeline != NULL) ? HostSeconds() : 0;
+
+    HandleException(which);
+    if (which != SyscallException)
+        return;
+    stats->syscallTime.EnterLog(stats->totalTicks - start);
+    if (timeline != NULL)
+        timeline->SystemCall(currentThread->getTrack(),
+                             (type >= 0 && type <= SC_Yield)
+                                 ? syscallNames[type]
+                                 : "syscall",
+                             start, hostStart);
+}
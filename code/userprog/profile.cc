@@ -0,0 +1,448 @@
+// profile.cc
+//	Routines to keep and report execution counts of user programs.
+//
+//	Enabled with "-profile"; the machine simulation then counts each
+//	instruction it executes in the arrays of the running address
+//	space (see Machine::Profile), and at Halt we print, for each
+//	address space, the instructions per procedure, the hottest
+//	instructions, and the instructions per opcode.
+//
+//	To name the procedures, we read the external symbols of the COFF
+//	file that the NOFF file was converted from (the same table that
+//	bin/out.c prints).  We look for it next to the NOFF file, and then
+//	in the arch/*/objects directories the test Makefile puts it in.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "profile.h"
+
+#include <stdlib.h>
+#include <dirent.h>
+
+// What we need to know of the MIPS COFF format: the file header (cf.
+// bin/coff.h), which says where the symbolic header is, and in that,
+// where the external symbols and their names are.  The symbols are
+// EXTR's, 16 bytes each; a procedure has symbol type stProc or
+// stStaticProc, in storage class scText.
+
+#define CoffMagic 0x0162		// MIPSELMAGIC
+#define CoffHeaderSize 20		// sizeof(struct filehdr)
+#define CoffSymPtr 8			// offset of f_symptr in it
+#define SymHeaderSize 96		// sizeof(HDRR)
+#define SymIssExtMax 64			// offsets of the fields we need
+#define SymCbSsExtOffset 68		// in HDRR
+#define SymIextMax 88
+#define SymCbExtOffset 92
+#define ExtSymSize 16			// sizeof(EXTR)
+#define stProc 6
+#define stStaticProc 14
+#define scText 1
+
+// One procedure, from the COFF symbol table.
+
+struct ProfileSymbol
+{
+    unsigned int value; // where its code starts
+    char *name;
+};
+
+// One line of a report: a count, and what it is the count of.
+
+struct ProfileLine
+{
+    unsigned int count;
+    int key; // symbol, word or opcode #
+};
+
+//----------------------------------------------------------------------
+// LittleWord, LittleShort
+// 	Get a little-endian (MIPS byte order) word or short out of the
+//	bytes read from a COFF file.
+//----------------------------------------------------------------------
+
+static unsigned int
+LittleWord(unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned int
+LittleShort(unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+//----------------------------------------------------------------------
+// CompareSymbols, CompareLines
+// 	Orders for qsort: symbols by address, report lines by count
+//	(biggest first, and in order of key when equal).
+//----------------------------------------------------------------------
+
+static int
+CompareSymbols(const void *a, const void *b)
+{
+    unsigned int x = ((ProfileSymbol *)a)->value;
+    unsigned int y = ((ProfileSymbol *)b)->value;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+static int
+CompareLines(const void *a, const void *b)
+{
+    ProfileLine *x = (ProfileLine *)a;
+    ProfileLine *y = (ProfileLine *)b;
+
+    if (x->count != y->count)
+        return (x->count > y->count) ? -1 : 1;
+    return x->key - y->key;
+}
+
+//----------------------------------------------------------------------
+// OpenCoff
+// 	Find the COFF file that the NOFF file "noffName" was made from:
+//	"dir/name.coff", or else "dir/arch/<any>/objects/name.coff".
+//
+//	Returns the open file (NULL if not found), and its name in
+//	"coffName".
+//----------------------------------------------------------------------
+
+static FILE *
+OpenCoff(char *noffName, char *coffName, int maxLength)
+{
+    char dir[256], base[256];
+    char *slash = strrchr(noffName, '/');
+    char *dot;
+    FILE *f;
+    DIR *archDir;
+    struct dirent *entry;
+
+    if (slash == NULL)
+    {
+        strcpy(dir, ".");
+        strncpy(base, noffName, sizeof(base) - 1);
+    }
+    else
+    {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - noffName), noffName);
+        strncpy(base, slash + 1, sizeof(base) - 1);
+    }
+    base[sizeof(base) - 1] = '\0';
+    dot = strrchr(base, '.');
+    if (dot != NULL && !strcmp(dot, ".noff"))
+        *dot = '\0';
+
+    snprintf(coffName, maxLength, "%s/%s.coff", dir, base);
+    if ((f = fopen(coffName, "rb")) != NULL)
+        return f;
+
+    snprintf(coffName, maxLength, "%s/arch", dir);
+    if ((archDir = opendir(coffName)) == NULL)
+        return NULL;
+    f = NULL;
+    while (f == NULL && (entry = readdir(archDir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(coffName, maxLength, "%s/arch/%s/objects/%s.coff",
+                 dir, entry->d_name, base);
+        f = fopen(coffName, "rb");
+    }
+    closedir(archDir);
+    return f;
+}
+
+//----------------------------------------------------------------------
+// ReadSymbols
+// 	Read the procedures out of the COFF file for "noffName", sorted
+//	by address.
+//
+//	Returns the number of procedures found (0 if there is no COFF
+//	file, or it doesn't make sense), with the table in "symbols" and
+//	the file name in "coffName".
+//----------------------------------------------------------------------
+
+static int
+ReadSymbols(char *noffName, ProfileSymbol **symbols, char *coffName,
+            int maxLength)
+{
+    unsigned char header[SymHeaderSize], ext[ExtSymSize];
+    unsigned int symPtr, numExt, extOffset, stringsSize, stringsOffset;
+    unsigned int iss, bits, i;
+    char *strings;
+    int count = 0;
+    FILE *f = OpenCoff(noffName, coffName, maxLength);
+
+    *symbols = NULL;
+    if (f == NULL)
+        return 0;
+    if (fread(header, CoffHeaderSize, 1, f) != 1 ||
+        LittleShort(header) != CoffMagic)
+    {
+        fclose(f);
+        return 0;
+    }
+    symPtr = LittleWord(header + CoffSymPtr);
+    if (fseek(f, symPtr, SEEK_SET) != 0 ||
+        fread(header, SymHeaderSize, 1, f) != 1)
+    {
+        fclose(f);
+        return 0;
+    }
+    numExt = LittleWord(header + SymIextMax);
+    extOffset = LittleWord(header + SymCbExtOffset);
+    stringsSize = LittleWord(header + SymIssExtMax);
+    stringsOffset = LittleWord(header + SymCbSsExtOffset);
+
+    strings = new char[stringsSize + 1];
+    if (fseek(f, stringsOffset, SEEK_SET) != 0 ||
+        fread(strings, 1, stringsSize, f) != stringsSize)
+        numExt = 0; // no names, no symbols
+    strings[stringsSize] = '\0';
+
+    *symbols = new ProfileSymbol[numExt > 0 ? numExt : 1];
+    fseek(f, extOffset, SEEK_SET);
+    for (i = 0; i < numExt; i++)
+    {
+        if (fread(ext, ExtSymSize, 1, f) != 1)
+            break;
+        iss = LittleWord(ext + 4);
+        bits = LittleWord(ext + 12);
+        if (((bits & 0x3f) != stProc && (bits & 0x3f) != stStaticProc) ||
+            ((bits >> 6) & 0x1f) != scText || iss >= stringsSize)
+            continue; // not a procedure
+        (*symbols)[count].value = LittleWord(ext + 8);
+        (*symbols)[count].name = new char[strlen(strings + iss) + 1];
+        strcpy((*symbols)[count].name, strings + iss);
+        count++;
+    }
+    delete[] strings;
+    fclose(f);
+
+    qsort(*symbols, count, sizeof(ProfileSymbol), CompareSymbols);
+    return count;
+}
+
+//----------------------------------------------------------------------
+// FindSymbol
+// 	Return the index of the procedure containing "addr": the last
+//	one starting at or before it.  -1 if there is none.
+//----------------------------------------------------------------------
+
+static int
+FindSymbol(ProfileSymbol *symbols, int numSymbols, unsigned int addr)
+{
+    int low = 0, high = numSymbols - 1, mid;
+
+    if (numSymbols == 0 || addr < symbols[0].value)
+        return -1;
+    while (low < high)
+    { // symbols[low].value <= addr
+        mid = (low + high + 1) / 2;
+        if (symbols[mid].value <= addr)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return low;
+}
+
+//----------------------------------------------------------------------
+// SpaceProfile::SpaceProfile
+// 	Set up zeroed counts for an address space.
+//
+//	"id" is the SpaceId of the address space
+//	"fileName" is the executable it is loaded from
+//	"size" is its size in bytes
+//----------------------------------------------------------------------
+
+SpaceProfile::SpaceProfile(int id, char *fileName, int size)
+{
+    unsigned int i;
+
+    spaceId = id;
+    name = new char[strlen(fileName) + 1];
+    strcpy(name, fileName);
+    numWords = size / 4;
+    pcCounts = new unsigned int[numWords];
+    for (i = 0; i < numWords; i++)
+        pcCounts[i] = 0;
+    opCounts = new unsigned int[NumOpcodes];
+    for (i = 0; i < NumOpcodes; i++)
+        opCounts[i] = 0;
+}
+
+SpaceProfile::~SpaceProfile()
+{
+    delete[] name;
+    delete[] pcCounts;
+    delete[] opCounts;
+}
+
+//----------------------------------------------------------------------
+// Profiler::Profiler, Profiler::~Profiler
+// 	Initialize and de-allocate the profiler.
+//----------------------------------------------------------------------
+
+Profiler::Profiler()
+{
+    spaces = new List();
+}
+
+Profiler::~Profiler()
+{
+    while (!spaces->IsEmpty())
+        delete (SpaceProfile *)spaces->Remove();
+    delete spaces;
+}
+
+//----------------------------------------------------------------------
+// Profiler::NewSpace
+// 	Start keeping counts for a new address space.  Returns them, to
+//	be passed to Switch whenever the address space starts running.
+//
+//	"spaceId" is the SpaceId of the address space
+//	"fileName" is the executable it is loaded from
+//	"size" is its size in bytes
+//----------------------------------------------------------------------
+
+SpaceProfile *
+Profiler::NewSpace(int spaceId, char *fileName, int size)
+{
+    SpaceProfile *space = new SpaceProfile(spaceId, fileName, size);
+
+    spaces->Append((void *)space);
+    return space;
+}
+
+//----------------------------------------------------------------------
+// Profiler::Switch
+// 	Count the instructions executed from now on for "space" (if NULL,
+//	don't count them).  Called on every context switch, from
+//	AddrSpace::RestoreState.
+//----------------------------------------------------------------------
+
+void Profiler::Switch(SpaceProfile *space)
+{
+    if (space == NULL)
+    {
+        machine->profileOps = NULL;
+        return;
+    }
+    machine->profileCounts = space->pcCounts;
+    machine->profileWords = space->numWords;
+    machine->profileOps = space->opCounts;
+}
+
+//----------------------------------------------------------------------
+// Profiler::Report
+// 	Print, for each address space that ran, how many instructions
+//	were executed in each procedure, the hottest instructions, and
+//	how many instructions of each kind were executed.  Called by
+//	Interrupt::Halt.
+//----------------------------------------------------------------------
+
+void Profiler::Report()
+{
+    ListElement *element;
+    SpaceProfile *space;
+    ProfileSymbol *symbols;
+    ProfileLine *lines;
+    int numSymbols, numLines, sym, i;
+    unsigned int total, word;
+    char coffName[512], op[16];
+
+    for (element = spaces->firstElement(); element != NULL;
+         element = element->next)
+    {
+        space = (SpaceProfile *)element->item;
+        total = 0;
+        for (i = 0; i < NumOpcodes; i++)
+            total += space->opCounts[i];
+        printf("\nProfile of space %d (%s): %u instructions\n",
+               space->spaceId, space->name, total);
+        if (total == 0)
+            continue;
+
+        numSymbols = ReadSymbols(space->name, &symbols, coffName,
+                                 sizeof(coffName));
+        if (numSymbols > 0)
+            printf("Symbols from %s\n", coffName);
+        else
+            printf("No COFF symbols found\n");
+
+        // instructions per procedure (the last line is for "unknown")
+        lines = new ProfileLine[numSymbols + 1];
+        for (i = 0; i <= numSymbols; i++)
+        {
+            lines[i].count = 0;
+            lines[i].key = i;
+        }
+        for (word = 0; word < space->numWords; word++)
+            if (space->pcCounts[word] != 0)
+            {
+                sym = FindSymbol(symbols, numSymbols, word * 4);
+                lines[(sym < 0) ? numSymbols : sym].count +=
+                    space->pcCounts[word];
+            }
+        qsort(lines, numSymbols + 1, sizeof(ProfileLine), CompareLines);
+        printf("  %10s %6s  %s\n", "count", "%", "procedure");
+        for (i = 0; i <= numSymbols && lines[i].count != 0; i++)
+            printf("  %10u %6.2f  %s\n", lines[i].count,
+                   100.0 * lines[i].count / total,
+                   (lines[i].key == numSymbols) ? "?"
+                                                : symbols[lines[i].key].name);
+        delete[] lines;
+
+        // the hottest instructions
+        lines = new ProfileLine[space->numWords];
+        numLines = 0;
+        for (word = 0; word < space->numWords; word++)
+            if (space->pcCounts[word] != 0)
+            {
+                lines[numLines].count = space->pcCounts[word];
+                lines[numLines].key = word;
+                numLines++;
+            }
+        qsort(lines, numLines, sizeof(ProfileLine), CompareLines);
+        printf("\n  %10s %6s  %-10s %s\n", "count", "%", "PC", "where");
+        for (i = 0; i < numLines && i < ProfileHotSpots; i++)
+        {
+            word = lines[i].key;
+            sym = FindSymbol(symbols, numSymbols, word * 4);
+            printf("  %10u %6.2f  0x%08x ", lines[i].count,
+                   100.0 * lines[i].count / total, word * 4);
+            if (sym < 0)
+                printf("?\n");
+            else
+                printf("%s+0x%x\n", symbols[sym].name,
+                       word * 4 - symbols[sym].value);
+        }
+        delete[] lines;
+
+        // instructions per opcode
+        lines = new ProfileLine[NumOpcodes];
+        for (i = 0; i < NumOpcodes; i++)
+        {
+            lines[i].count = space->opCounts[i];
+            lines[i].key = i;
+        }
+        qsort(lines, NumOpcodes, sizeof(ProfileLine), CompareLines);
+        printf("\n  %10s %6s  %s\n", "count", "%", "opcode");
+        for (i = 0; i < NumOpcodes && lines[i].count != 0; i++)
+        {
+            OpcodeName(lines[i].key, op, sizeof(op));
+            printf("  %10u %6.2f  %s\n", lines[i].count,
+                   100.0 * lines[i].count / total, op);
+        }
+        delete[] lines;
+
+        for (i = 0; i < numSymbols; i++)
+            delete[] symbols[i].name;
+        delete[] symbols;
+    }
+}
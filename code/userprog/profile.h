@@ -0,0 +1,58 @@
+// profile.h
+//	Data structures for profiling user programs: counting how often
+//	each instruction of each address space is executed, and reporting
+//	where the time went when Nachos halts.
+//
+//	The counting itself is done by the machine simulation (see
+//	Machine::Profile); the kernel just tells it where to count, on
+//	every context switch.  The report is symbolized from the COFF
+//	file the program's NOFF file was made from, if it can be found.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "copyright.h"
+#include "list.h"
+
+#define ProfileHotSpots 20 // # of hottest instructions to report
+
+// The execution counts for one address space.  These stay around after
+// the address space is deleted, so they can be reported at the end.
+
+class SpaceProfile
+{
+public:
+  SpaceProfile(int id, char *fileName, int size);
+  ~SpaceProfile();
+
+  int spaceId;            // the SpaceId of the address space
+  char *name;             // the executable it was loaded from
+  unsigned int numWords;  // # of words in the address space
+  unsigned int *pcCounts; // executions of each word, by PC / 4
+  unsigned int *opCounts; // executions of each opcode
+};
+
+// The following class keeps the profiles of all address spaces.
+
+class Profiler
+{
+public:
+  Profiler();  // Initialize, with no address spaces
+  ~Profiler(); // De-allocate all the counts
+
+  SpaceProfile *NewSpace(int spaceId, char *fileName, int size);
+  // Start counting for a new address space
+  void Switch(SpaceProfile *space); // Count for "space" from now on;
+                                    // NULL if it isn't profiled
+  void Report();                    // Print where each address space
+                                    // spent its instructions
+
+private:
+  List *spaces; // every SpaceProfile, in the order created
+};
+
+#endif // PROFILE_H
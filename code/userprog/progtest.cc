@@ -34,6 +34,7 @@ void StartProcess(char *filename)
         return;
     }
     space = new AddrSpace(executable);
+    space->StartProfile(filename);
     currentThread->space = space; // 将当前进程映射到核心进程
     space->Print();               // 输出改作业的页表信息
 
@@ -48,6 +49,85 @@ void StartProcess(char *filename)
                     // by doing the syscall "exit"
 }
 
+//----------------------------------------------------------------------
+// PeriodicJobs
+// 	The body of the real-time thread of PeriodicTest: "jobs" jobs
+//	that take no time at all, so that it is nearly always waiting
+//	for its next period, with the release pending.
+//----------------------------------------------------------------------
+
+static void PeriodicJobs(_int jobs)
+{
+    for (int i = 0; i < jobs; i++)
+        currentThread->WaitForPeriod();
+}
+
+//----------------------------------------------------------------------
+// PeriodicTest
+// 	Run a user program alongside a real-time kernel thread, to test
+//	checkpointing with a scheduler interrupt pending: a -checkpoint
+//	of this run saves the thread's next release, and the -restore of
+//	it, which has no such thread, must drop that and carry on with
+//	the program (see Interrupt::Restore).
+//----------------------------------------------------------------------
+
+void PeriodicTest(char *filename)
+{
+    Thread *t = new Thread("periodic");
+
+    if (!t->SetPeriodic(1000, 100))
+    {
+        printf("Unable to admit the real-time thread\n");
+        return;
+    }
+    t->Fork(PeriodicJobs, 1000);
+    StartProcess(filename);
+}
+
+//----------------------------------------------------------------------
+// RunCopy
+// 	The body of each thread of ParallelTest but the first: run the
+//	copy of the user program loaded into its address space.
+//----------------------------------------------------------------------
+
+static void RunCopy(_int dummy)
+{
+    currentThread->space->InitRegisters(); // set the initial register values
+    currentThread->space->RestoreState();  // load page table register
+
+    machine->Run(); // jump to the user progam
+    ASSERT(FALSE);  // machine->Run never returns
+}
+
+//----------------------------------------------------------------------
+// ParallelTest
+// 	Run "copies" copies of a user program at once, each in an address
+//	space and thread of its own, to test running user programs on more
+//	than one CPU (-cpus).  The first copy is run by this thread, so
+//	like StartProcess, this never returns.
+//----------------------------------------------------------------------
+
+void ParallelTest(char *filename, int copies)
+{
+    OpenFile *executable = fileSystem->Open(filename);
+
+    if (executable == NULL)
+    {
+        printf("Unable to open file %s\n", filename);
+        return;
+    }
+    ASSERT(copies > 0);
+    for (int i = 1; i < copies; i++)
+    {
+        Thread *t = new Thread("copy");
+
+        t->space = new AddrSpace(executable);
+        t->Fork(RunCopy, 0);
+    }
+    delete executable; // close file
+    StartProcess(filename);
+}
+
 // Data structures needed for the console test.  Threads making
 // I/O requests wait on a Semaphore to delay until the I/O completes.
 
@@ -0,0 +1,267 @@
+// smp.cc
+//	Routines for running user programs on more than one simulated CPU
+//	at once, each on a host thread of its own, taking turns in the
+//	kernel.  See smp.h.
+//
+//	While a CPU is outside the kernel, all that is left of it for the
+//	kernel is the CPU object: which thread it is running, and the
+//	interrupt level and machine status it left with, which it takes
+//	up again when it comes back in.  Changes the kernel makes that
+//	concern the others -- code it overwrites in main memory, address
+//	spaces it deletes -- are queued for each of them, and carried out
+//	by the CPU itself as it enters the kernel, since its decoded
+//	instructions and TLB are only touched by its own host thread.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "smp.h"
+
+// The kernel's view of a CPU.
+
+class CPU
+{
+public:
+  CPU(int which, Machine *cpuMachine);
+
+  int number;           // which CPU this is
+  Machine *machine;     // its registers, TLB and decoded instructions
+  Thread *current;      // the thread it is running
+  IntStatus level;      // the interrupt level and machine status it
+  MachineStatus status; // had when it last left the kernel
+  bool inKernel;        // it holds the kernel lock
+  void *wakeUp;         // host condition it waits on when idle
+
+  bool *stalePages; // physical pages whose decoded instructions
+                    // it must throw away, when it next enters
+  bool anyStale;    // at least one of them is
+  List *deadSpaces; // ASIDs it must flush from its TLB, likewise
+                    // (kept as the keys)
+};
+
+static CPU **cpus;       // every CPU, by number
+static void *kernelLock; // held by the CPU running kernel code
+
+//----------------------------------------------------------------------
+// CPU::CPU
+// 	Initialize CPU "which", simulated by "cpuMachine", as if it had
+//	just been switched on: in the kernel, with interrupts off.
+//----------------------------------------------------------------------
+
+CPU::CPU(int which, Machine *cpuMachine)
+{
+    number = which;
+    machine = cpuMachine;
+    machine->cpuNum = which;
+    machine->counts = new Statistics(); // see Statistics::TakeCounts
+    current = NULL;
+    level = IntOff;
+    status = SystemMode;
+    inKernel = FALSE;
+    wakeUp = NewHostCondition();
+    stalePages = new bool[numPhysPages];
+    for (int i = 0; i < numPhysPages; i++)
+        stalePages[i] = FALSE;
+    anyStale = FALSE;
+    deadSpaces = new List;
+}
+
+//----------------------------------------------------------------------
+// Resume
+// 	Make "cpu", which has just taken the kernel lock, the one the
+//	kernel runs on: switch the globals over to it, collect its counts,
+//	and catch up with what the other CPUs have changed meanwhile.
+//----------------------------------------------------------------------
+
+static void Resume(CPU *cpu)
+{
+    currentCPU = cpu->number;
+    machine = cpu->machine;
+    currentThread = cpu->current;
+    interrupt->SwitchCPU(cpu->level, cpu->status);
+    stats->TakeCounts(machine->counts);
+
+    if (cpu->anyStale)
+    {
+        for (int i = 0; i < numPhysPages; i++)
+            if (cpu->stalePages[i])
+            {
+                machine->InvalidateDecodedPage(i);
+                cpu->stalePages[i] = FALSE;
+            }
+        cpu->anyStale = FALSE;
+    }
+    while (!cpu->deadSpaces->IsEmpty())
+    {
+        int asid;
+
+        (void)cpu->deadSpaces->SortedRemove(&asid);
+        machine->FlushTLB(asid);
+    }
+}
+
+//----------------------------------------------------------------------
+// Suspend
+// 	"cpu" is about to give up the kernel lock: remember where it was.
+//----------------------------------------------------------------------
+
+static void Suspend(CPU *cpu)
+{
+    cpu->current = currentThread;
+    cpu->level = interrupt->getLevel();
+    cpu->status = interrupt->getStatus();
+}
+
+//----------------------------------------------------------------------
+// EnterKernel
+// 	Called by CPU "which" on a trap, or at the end of a burst of user
+//	instructions: wait until no other CPU is in the kernel, and then
+//	go in.  Returns FALSE, doing nothing, if the CPU is in the kernel
+//	already (the kernel itself caused the trap).
+//----------------------------------------------------------------------
+
+bool EnterKernel(int which)
+{
+    CPU *cpu = cpus[which];
+
+    if (cpu->inKernel)
+        return FALSE;
+    HostLockAcquire(kernelLock);
+    cpu->inKernel = TRUE;
+    Resume(cpu);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// LeaveKernel
+// 	Called by CPU "which" as it goes back to running user code: let
+//	the other CPUs into the kernel.  The thread that is running is
+//	bound to this CPU from now on.
+//----------------------------------------------------------------------
+
+void LeaveKernel(int which)
+{
+    CPU *cpu = cpus[which];
+
+    ASSERT(cpu->inKernel && !interrupt->isInHandler());
+    if (currentThread->cpu < 0)
+        currentThread->cpu = which; // our frames are on its stack now
+    Suspend(cpu);
+    cpu->inKernel = FALSE;
+    HostLockRelease(kernelLock);
+}
+
+//----------------------------------------------------------------------
+// WaitForWork
+// 	Called by the scheduler, when there is nothing for this CPU to
+//	run: let the other CPUs into the kernel until one of them puts a
+//	thread on its queue (or it is the only one left busy).  The
+//	caller must check again for a thread to run when this returns.
+//----------------------------------------------------------------------
+
+void WaitForWork()
+{
+    CPU *cpu = cpus[currentCPU];
+
+    Suspend(cpu);
+    HostConditionWait(cpu->wakeUp, kernelLock);
+    Resume(cpu);
+}
+
+//----------------------------------------------------------------------
+// WakeCPU
+// 	Wake up "which", which is waiting in WaitForWork.
+//----------------------------------------------------------------------
+
+void WakeCPU(int which)
+{
+    HostConditionSignal(cpus[which]->wakeUp);
+}
+
+//----------------------------------------------------------------------
+// CPURoot
+// 	The host thread of CPU "which" (not 0).  Once it gets into the
+//	kernel, it makes a thread of its own to stand for its host stack,
+//	as Initialize does for "main", and puts that to sleep for good:
+//	from then on, it only runs the threads the scheduler gives it.
+//----------------------------------------------------------------------
+
+static void CPURoot(_int which)
+{
+    char *name = new char[16];
+
+    (void)EnterKernel(which);
+    sprintf(name, "cpu %d", (int)which);
+    currentThread = new Thread(name);
+    currentThread->cpu = which; // its stack is this host thread's
+    currentThread->setStatus(RUNNING);
+    currentThread->Sleep();
+    ASSERT(FALSE); // no one wakes it up
+}
+
+//----------------------------------------------------------------------
+// StartCPUs
+// 	Make the other numCPUs-1 CPUs, with Machines like "machine", and
+//	sharing its memory, and start their host threads.  They wait for
+//	the kernel, which the caller, CPU 0, holds until it first runs
+//	user code.
+//
+//	"engine" -- how they are to execute user instructions
+//----------------------------------------------------------------------
+
+void StartCPUs(ExecEngine engine)
+{
+    kernelLock = NewHostLock();
+    cpus = new CPU *[numCPUs];
+    cpus[0] = new CPU(0, machine);
+    for (int i = 1; i < numCPUs; i++)
+    {
+        cpus[i] = new CPU(i, new Machine(FALSE, engine, machine->mainMemory));
+        if (profiler != NULL)
+            cpus[i]->machine->EnableProfile();
+    }
+
+    HostLockAcquire(kernelLock);
+    cpus[0]->inKernel = TRUE;
+    Suspend(cpus[0]); // (it carries on as it is)
+    for (int i = 1; i < numCPUs; i++)
+        StartHostThread(CPURoot, i);
+}
+
+//----------------------------------------------------------------------
+// InvalidateCode
+// 	Throw away the instructions decoded from physical page "physPage",
+//	which the kernel is about to write to: on this CPU now, and on the
+//	others when they next enter the kernel (until then, they can only
+//	be running other address spaces).  With one CPU, cpus[] isn't
+//	needed, since that is this one.
+//----------------------------------------------------------------------
+
+void InvalidateCode(int physPage)
+{
+    machine->InvalidateDecodedPage(physPage);
+    for (int i = 0; i < numCPUs; i++)
+        if (i != currentCPU)
+        {
+            cpus[i]->stalePages[physPage] = TRUE;
+            cpus[i]->anyStale = TRUE;
+        }
+}
+
+//----------------------------------------------------------------------
+// FlushSpaceTLB
+// 	Flush the TLB entries of address space "asid", which is going
+//	away: from this CPU's TLB now, and from the others' when they
+//	next enter the kernel.
+//----------------------------------------------------------------------
+
+void FlushSpaceTLB(int asid)
+{
+    machine->FlushTLB(asid);
+    for (int i = 0; i < numCPUs; i++)
+        if (i != currentCPU)
+            cpus[i]->deadSpaces->SortedInsert(NULL, asid);
+}
@@ -0,0 +1,57 @@
+// smp.h
+//	Routines for running user programs on more than one simulated CPU
+//	at once (-cpus).
+//
+//	Each CPU is a Machine of its own -- registers, TLB and decoded
+//	instructions -- and they all share one main memory.  Each is run
+//	by a host thread of its own, so user programs on different CPUs
+//	really do run at the same time.  The kernel, though, is run by
+//	one CPU at a time: a CPU takes the kernel lock on every trap and
+//	at the end of every burst of instructions (EnterKernel, see
+//	Machine::Tick), and gives it up to go back to user code
+//	(LeaveKernel).  So the kernel's data structures need no locks of
+//	their own, and "machine" and "currentThread" are those of the CPU
+//	holding the lock.
+//
+//	A thread that has run user code stays on that CPU, since its
+//	stack holds the frames of that CPU's Machine::Run; threads that
+//	only run in the kernel can go to any CPU.  The scheduler keeps a
+//	ready queue for each CPU (see Scheduler::ReadyToRun).
+//
+//	There is one clock: the instructions of every CPU are charged to
+//	it, so a run takes about as many ticks as running its programs
+//	one after another would; it is the host time that goes down.  The
+//	timer interrupts whichever CPU the time runs out on.  Only the
+//	FIFO scheduler is supported, with no real-time threads, and not
+//	single stepping, tracing, checkpoints or the inverted page table,
+//	which assume a single Machine.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SMP_H
+#define SMP_H
+
+#include "copyright.h"
+#include "machine.h"
+
+extern void StartCPUs(ExecEngine engine);
+// Make CPUs 1 .. numCPUs-1, and start
+// them; CPU 0, the caller's, holds the
+// kernel until it first runs user code
+extern void WaitForWork();
+// Idle this CPU, letting the others
+// into the kernel, until WakeCPU
+extern void WakeCPU(int cpu);
+// A thread has been put on the ready
+// queue of "cpu", which is idle
+extern void InvalidateCode(int physPage);
+// Physical page "physPage" is being
+// written by the kernel: throw away the
+// instructions any CPU decoded from it
+extern void FlushSpaceTLB(int asid);
+// Address space "asid" is going away:
+// flush its entries from every TLB
+
+#endif // SMP_H
@@ -0,0 +1,126 @@
+// usermem.cc
+//	Routines for the kernel to copy data to and from user memory.
+//	See usermem.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "addrspace.h"
+#include "usermem.h"
+
+//----------------------------------------------------------------------
+// UserSpan
+// 	Translate user address "virtAddr" for an access of up to "size"
+//	bytes, and return where the part of it in the same page is, in
+//	mainMemory, and how long that part is.  A TLB miss is refilled
+//	here, as ExceptionHandler would; otherwise, returns NULL if the
+//	page can't be translated.  No exception is raised: we are in the
+//	middle of a system call, which is to fail, not the user program.
+//
+//	"writing" -- if TRUE, the page must be writable; any instructions
+//		decoded from it are thrown away, since we will change it
+//----------------------------------------------------------------------
+
+static char *UserSpan(int virtAddr, int size, bool writing, int *span)
+{
+    int physAddr;
+    ExceptionType exception;
+
+    exception = machine->Translate(virtAddr, &physAddr, 1, writing);
+    if (exception == PageFaultException && machine->tlb != NULL &&
+        currentThread->space->RefillTLB(virtAddr))
+        exception = machine->Translate(virtAddr, &physAddr, 1, writing);
+    if (exception != NoException)
+    {
+        DEBUG('a', "Bad user address 0x%x in a system call\n", virtAddr);
+        return NULL;
+    }
+    *span = pageSize - physAddr % pageSize;
+    if (*span > size)
+        *span = size;
+    if (writing)
+        InvalidateCode(physAddr / pageSize);
+    return &machine->mainMemory[physAddr];
+}
+
+//----------------------------------------------------------------------
+// CopyFromUser
+// 	Copy "size" bytes of user memory, starting at virtual address
+//	"virtAddr", into the kernel "buffer".  Returns FALSE if some page
+//	couldn't be translated.
+//----------------------------------------------------------------------
+
+bool CopyFromUser(int virtAddr, char *buffer, int size)
+{
+    char *from;
+    int span;
+
+    while (size > 0)
+    {
+        if ((from = UserSpan(virtAddr, size, FALSE, &span)) == NULL)
+            return FALSE;
+        bcopy(from, buffer, span);
+        virtAddr += span;
+        buffer += span;
+        size -= span;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// CopyToUser
+// 	Copy "size" bytes from the kernel "buffer" into user memory,
+//	starting at virtual address "virtAddr".  Returns FALSE if some
+//	page couldn't be translated, or is read-only.
+//----------------------------------------------------------------------
+
+bool CopyToUser(int virtAddr, char *buffer, int size)
+{
+    char *to;
+    int span;
+
+    while (size > 0)
+    {
+        if ((to = UserSpan(virtAddr, size, TRUE, &span)) == NULL)
+            return FALSE;
+        bcopy(buffer, to, span);
+        virtAddr += span;
+        buffer += span;
+        size -= span;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// StringFromUser
+// 	Copy a null-terminated string from user memory, starting at
+//	virtual address "virtAddr", into the kernel "buffer", which can
+//	hold "size" bytes including the null.  Returns the length of the
+//	string, or -1 if it is too long or some page couldn't be
+//	translated.
+//----------------------------------------------------------------------
+
+int StringFromUser(int virtAddr, char *buffer, int size)
+{
+    char *from, *end;
+    int span, length = 0;
+
+    while (length < size)
+    {
+        if ((from = UserSpan(virtAddr, size - length, FALSE, &span)) == NULL)
+            return -1;
+        end = (char *)memchr(from, '\0', span);
+        if (end != NULL)
+        { // found the end of the string
+            bcopy(from, buffer + length, end - from + 1);
+            return length + (end - from);
+        }
+        bcopy(from, buffer + length, span);
+        virtAddr += span;
+        length += span;
+    }
+    return -1; // no room for the null
+}
@@ -0,0 +1,37 @@
+// usermem.h
+//	Routines for the kernel to copy data to and from the address space
+//	of the running user program, for instance the arguments of a
+//	system call.
+//
+//	Rather than calling machine->ReadMem or WriteMem for every byte,
+//	these translate each page once, and copy whatever falls in it
+//	directly to or from mainMemory.
+//
+//	If a page can't be translated, the copy fails, and the part before
+//	the bad page has been copied.  No exception is raised; it is up to
+//	the caller to make the system call fail (for instance, by returning
+//	-1 to the user program).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef USERMEM_H
+#define USERMEM_H
+
+#include "copyright.h"
+
+extern bool CopyFromUser(int virtAddr, char *buffer, int size);
+// Copy "size" bytes at user address
+// "virtAddr" into "buffer"; FALSE if
+// some page couldn't be translated
+extern bool CopyToUser(int virtAddr, char *buffer, int size);
+// Copy "size" bytes from "buffer" to
+// user address "virtAddr"
+extern int StringFromUser(int virtAddr, char *buffer, int size);
+// Copy the null-terminated string at
+// "virtAddr" into "buffer", which holds
+// "size" bytes.  Returns its length, or
+// -1 if it didn't fit or faulted
+
+#endif // USERMEM_H